@@ -0,0 +1,8 @@
+#pragma once
+
+// Shared by the GL and CPU backends. The layout must match the Agent struct
+// in shaders/agent.glsl (std430, 16 bytes per agent).
+struct Agent {
+    float x, y, angle;
+    int species;
+};
@@ -0,0 +1,49 @@
+#include "agent_arrays.h"
+
+#include <cstring>
+
+namespace {
+
+const std::align_val_t ALIGNMENT{64};
+
+void* allocate(int count) {
+    void* data = ::operator new(static_cast<size_t>(count) * 4, ALIGNMENT);
+    std::memset(data, 0, static_cast<size_t>(count) * 4);
+    return data;
+}
+
+}
+
+AgentArrays::~AgentArrays() {
+    release();
+}
+
+void AgentArrays::resize(int newCount) {
+    release();
+    count = newCount;
+    paddedCount = (newCount + LANES - 1) / LANES * LANES;
+    if (paddedCount == 0) {
+        return;
+    }
+    x = static_cast<float*>(allocate(paddedCount));
+    y = static_cast<float*>(allocate(paddedCount));
+    angle = static_cast<float*>(allocate(paddedCount));
+    species = static_cast<int*>(allocate(paddedCount));
+}
+
+void AgentArrays::set(int i, const Agent& agent) {
+    x[i] = agent.x;
+    y[i] = agent.y;
+    angle[i] = agent.angle;
+    species[i] = agent.species;
+}
+
+void AgentArrays::release() {
+    ::operator delete(x, ALIGNMENT);
+    ::operator delete(y, ALIGNMENT);
+    ::operator delete(angle, ALIGNMENT);
+    ::operator delete(species, ALIGNMENT);
+    x = y = angle = nullptr;
+    species = nullptr;
+    count = paddedCount = 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "agent.h"
+
+#include <cstddef>
+#include <new>
+
+// Structure-of-arrays agent storage for the CPU backend. Every array is
+// 64-byte aligned and padded to a multiple of LANES, so SIMD kernels load
+// whole vectors and never need a scalar tail. Padding agents are updated
+// like real ones but are never deposited.
+class AgentArrays {
+public:
+    // Widest vector the kernels use (AVX-512, 16 floats)
+    static constexpr int LANES = 16;
+
+    AgentArrays() = default;
+    ~AgentArrays();
+    AgentArrays(const AgentArrays&) = delete;
+    AgentArrays& operator=(const AgentArrays&) = delete;
+
+    // Resizes to count agents and zeroes everything
+    void resize(int count);
+
+    int size() const { return count; }
+    int padded_size() const { return paddedCount; }
+
+    Agent get(int i) const { return Agent{x[i], y[i], angle[i], species[i]}; }
+    void set(int i, const Agent& agent);
+
+    float* x = nullptr;
+    float* y = nullptr;
+    float* angle = nullptr;
+    int* species = nullptr;
+
+private:
+    void release();
+
+    int count = 0;
+    int paddedCount = 0;
+};
@@ -0,0 +1,75 @@
+#include "agent_kernel_impl.h"
+
+#include <cmath>
+
+namespace {
+
+// One agent at a time. Reference implementation and fallback for CPUs
+// without AVX2. min/max follow the SSE convention (second operand unless
+// the first compares greater/less) so signed zeros match the SIMD paths.
+struct ScalarOps {
+    static constexpr int WIDTH = 1;
+    using Float = float;
+    using Int = int32_t;
+    using Mask = bool;
+
+    static Float set1(float value) { return value; }
+    static Int set1_int(int value) { return value; }
+    static Float load(const float* p) { return *p; }
+    static Int load_int(const int* p) { return *p; }
+    static void store(float* p, Float value) { *p = value; }
+    static Int index(int i) { return i; }
+
+    static Float add(Float a, Float b) { return a + b; }
+    static Float sub(Float a, Float b) { return a - b; }
+    static Float mul(Float a, Float b) { return a * b; }
+    static Float min(Float a, Float b) { return a < b ? a : b; }
+    static Float max(Float a, Float b) { return a > b ? a : b; }
+    static Float neg(Float a) { return -a; }
+    static Float floor(Float a) { return std::floor(a); }
+
+    static Int add_int(Int a, Int b) { return static_cast<Int>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+    static Int mul_int(Int a, Int b) { return static_cast<Int>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)); }
+    static Int mul_hi_int(Int a, Int b) {
+        return static_cast<Int>(static_cast<uint64_t>(static_cast<uint32_t>(a)) * static_cast<uint32_t>(b) >> 32);
+    }
+    static Int and_int(Int a, Int b) { return a & b; }
+    static Int xor_int(Int a, Int b) { return a ^ b; }
+    static Int shift_right(Int a, int bits) { return static_cast<Int>(static_cast<uint32_t>(a) >> bits); }
+    static Int min_int(Int a, Int b) { return a < b ? a : b; }
+    static Int max_int(Int a, Int b) { return a > b ? a : b; }
+
+    static Int to_int(Float a) { return static_cast<Int>(a); }
+    static Float to_float(Int a) { return static_cast<Float>(a); }
+
+    static Mask lt(Float a, Float b) { return a < b; }
+    static Mask le(Float a, Float b) { return a <= b; }
+    static Mask gt(Float a, Float b) { return a > b; }
+    static Mask ge(Float a, Float b) { return a >= b; }
+    static Mask eq_int(Int a, Int b) { return a == b; }
+    static Mask and_mask(Mask a, Mask b) { return a && b; }
+    static Mask or_mask(Mask a, Mask b) { return a || b; }
+    static Float select(Mask mask, Float a, Float b) { return mask ? a : b; }
+
+    static Float gather(const float* base, Int index) { return base[index]; }
+};
+
+}
+
+void update_agents_scalar(AgentArrays& agents, int begin, int end, const AgentKernelParams& params) {
+    agent_kernel::update_agents<ScalarOps>(agents, begin, end, params);
+}
+
+AgentKernel select_agent_kernel(SimdLevel requested, SimdLevel& selected) {
+    SimdLevel supported = detect_simd_level();
+    selected = requested;
+    if (requested == SimdLevel::Auto || requested > supported) {
+        selected = supported;
+    }
+
+    switch (selected) {
+        case SimdLevel::Avx512: return update_agents_avx512;
+        case SimdLevel::Avx2: return update_agents_avx2;
+        default: return update_agents_scalar;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "agent_arrays.h"
+#include "cpu_features.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Inputs shared by every agent in one step
+struct AgentKernelParams {
+    // Layers of RGBA, row-major. Species s is channel s % 4 of layer s / 4.
+    // This is the level of the trail's mip pyramid the sensors read:
+    // sensorLod halvings of width x height, rounded down and at least 1.
+    const float* trailMap;
+    size_t layerSize;           // Floats per layer
+    int sensorLod;
+    int levelWidth;
+    int levelHeight;
+    float sensorOffset;         // Pixels ahead of the agent
+    int speciesCount;
+    // Weight of trail species t for sensing species s at [t * speciesCount + s],
+    // the transpose of species.h's layout so lanes gather by their own species
+    const float* interactions;
+    // ObstacleField::texels of the same size, or null without walls
+    const float* obstacles;
+    // One float per pixel sensed on top of the trail, or null without an
+    // attractor, see attractor.h
+    const float* attractor;
+    float attractorWeight;
+    int width;
+    int height;
+    bool wrap;              // Opposite edges meet instead of bouncing, see BoundaryMode
+    float deltaTime;
+    uint32_t seed;          // Philox key, see philox.h
+    uint32_t step;          // Steps since the start, the counter's second word
+};
+
+// Sense, steer, move and bounce or wrap for agents [begin, end). Both bounds must be
+// multiples of AgentArrays::LANES. All variants give bit-identical results.
+using AgentKernel = void (*)(AgentArrays& agents, int begin, int end, const AgentKernelParams& params);
+
+void update_agents_scalar(AgentArrays& agents, int begin, int end, const AgentKernelParams& params);
+void update_agents_avx2(AgentArrays& agents, int begin, int end, const AgentKernelParams& params);
+void update_agents_avx512(AgentArrays& agents, int begin, int end, const AgentKernelParams& params);
+
+// Kernel for the requested level. Auto picks the widest supported one, and
+// levels this CPU can't run fall back to it as well.
+AgentKernel select_agent_kernel(SimdLevel requested, SimdLevel& selected);
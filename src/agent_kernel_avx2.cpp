@@ -0,0 +1,66 @@
+#include "agent_kernel_impl.h"
+
+#include <immintrin.h>
+
+// Built with AVX2 enabled (see CMakeLists.txt), only called after
+// detect_simd_level() confirmed support
+namespace {
+
+// Eight agents per instruction. Masks live in float registers so they can
+// feed blendv directly.
+struct Avx2Ops {
+    static constexpr int WIDTH = 8;
+    using Float = __m256;
+    using Int = __m256i;
+    using Mask = __m256;
+
+    static Float set1(float value) { return _mm256_set1_ps(value); }
+    static Int set1_int(int value) { return _mm256_set1_epi32(value); }
+    static Float load(const float* p) { return _mm256_load_ps(p); }
+    static Int load_int(const int* p) { return _mm256_load_si256(reinterpret_cast<const __m256i*>(p)); }
+    static void store(float* p, Float value) { _mm256_store_ps(p, value); }
+    static Int index(int i) { return _mm256_add_epi32(_mm256_set1_epi32(i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); }
+
+    static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+    static Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+    static Float neg(Float a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+    static Float floor(Float a) { return _mm256_floor_ps(a); }
+
+    static Int add_int(Int a, Int b) { return _mm256_add_epi32(a, b); }
+    static Int mul_int(Int a, Int b) { return _mm256_mullo_epi32(a, b); }
+    static Int mul_hi_int(Int a, Int b) {
+        // Unsigned 32x32 -> 64 only exists for the even lanes, so the odd
+        // ones are shifted down, and each result keeps its high half
+        __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(a, b), 32);
+        __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+        return _mm256_blend_epi32(even, odd, 0xAA);
+    }
+    static Int and_int(Int a, Int b) { return _mm256_and_si256(a, b); }
+    static Int xor_int(Int a, Int b) { return _mm256_xor_si256(a, b); }
+    static Int shift_right(Int a, int bits) { return _mm256_srl_epi32(a, _mm_cvtsi32_si128(bits)); }
+    static Int min_int(Int a, Int b) { return _mm256_min_epi32(a, b); }
+    static Int max_int(Int a, Int b) { return _mm256_max_epi32(a, b); }
+
+    static Int to_int(Float a) { return _mm256_cvttps_epi32(a); }
+    static Float to_float(Int a) { return _mm256_cvtepi32_ps(a); }
+
+    static Mask lt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Mask le(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static Mask gt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static Mask ge(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static Mask eq_int(Int a, Int b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+    static Mask and_mask(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    static Mask or_mask(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+    static Float select(Mask mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+
+    static Float gather(const float* base, Int index) { return _mm256_i32gather_ps(base, index, 4); }
+};
+
+}
+
+void update_agents_avx2(AgentArrays& agents, int begin, int end, const AgentKernelParams& params) {
+    agent_kernel::update_agents<Avx2Ops>(agents, begin, end, params);
+}
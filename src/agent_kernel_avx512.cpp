@@ -0,0 +1,70 @@
+#include "agent_kernel_impl.h"
+
+#include <immintrin.h>
+
+// Built with AVX-512F enabled (see CMakeLists.txt), only called after
+// detect_simd_level() confirmed support
+namespace {
+
+// Sixteen agents per instruction, with comparisons in mask registers
+struct Avx512Ops {
+    static constexpr int WIDTH = 16;
+    using Float = __m512;
+    using Int = __m512i;
+    using Mask = __mmask16;
+
+    static Float set1(float value) { return _mm512_set1_ps(value); }
+    static Int set1_int(int value) { return _mm512_set1_epi32(value); }
+    static Float load(const float* p) { return _mm512_load_ps(p); }
+    static Int load_int(const int* p) { return _mm512_load_si512(p); }
+    static void store(float* p, Float value) { _mm512_store_ps(p, value); }
+    static Int index(int i) {
+        return _mm512_add_epi32(_mm512_set1_epi32(i),
+                                _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    }
+
+    static Float add(Float a, Float b) { return _mm512_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+    static Float min(Float a, Float b) { return _mm512_min_ps(a, b); }
+    static Float max(Float a, Float b) { return _mm512_max_ps(a, b); }
+    static Float neg(Float a) {
+        // _mm512_xor_ps needs AVX-512DQ, go through the integer side
+        return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(static_cast<int>(0x80000000u))));
+    }
+    static Float floor(Float a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+    static Int add_int(Int a, Int b) { return _mm512_add_epi32(a, b); }
+    static Int mul_int(Int a, Int b) { return _mm512_mullo_epi32(a, b); }
+    static Int mul_hi_int(Int a, Int b) {
+        // As in the AVX2 version: even lanes directly, odd lanes shifted down
+        __m512i even = _mm512_srli_epi64(_mm512_mul_epu32(a, b), 32);
+        __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(b, 32));
+        return _mm512_mask_blend_epi32(0xAAAA, even, odd);
+    }
+    static Int and_int(Int a, Int b) { return _mm512_and_si512(a, b); }
+    static Int xor_int(Int a, Int b) { return _mm512_xor_si512(a, b); }
+    static Int shift_right(Int a, int bits) { return _mm512_srl_epi32(a, _mm_cvtsi32_si128(bits)); }
+    static Int min_int(Int a, Int b) { return _mm512_min_epi32(a, b); }
+    static Int max_int(Int a, Int b) { return _mm512_max_epi32(a, b); }
+
+    static Int to_int(Float a) { return _mm512_cvttps_epi32(a); }
+    static Float to_float(Int a) { return _mm512_cvtepi32_ps(a); }
+
+    static Mask lt(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static Mask le(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+    static Mask gt(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static Mask ge(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+    static Mask eq_int(Int a, Int b) { return _mm512_cmpeq_epi32_mask(a, b); }
+    static Mask and_mask(Mask a, Mask b) { return static_cast<Mask>(a & b); }
+    static Mask or_mask(Mask a, Mask b) { return static_cast<Mask>(a | b); }
+    static Float select(Mask mask, Float a, Float b) { return _mm512_mask_blend_ps(mask, b, a); }
+
+    static Float gather(const float* base, Int index) { return _mm512_i32gather_ps(index, base, 4); }
+};
+
+}
+
+void update_agents_avx512(AgentArrays& agents, int begin, int end, const AgentKernelParams& params) {
+    agent_kernel::update_agents<Avx512Ops>(agents, begin, end, params);
+}
@@ -0,0 +1,259 @@
+#pragma once
+#include "agent_kernel.h"
+#include "philox.h"
+
+// Agent update from shaders/agents.glsl, written once against a small set of
+// vector operations. agent_kernel.cpp, agent_kernel_avx2.cpp and
+// agent_kernel_avx512.cpp each supply an Ops type and instantiate it with
+// their own compiler flags.
+//
+// Ops needs: Float, Int, Mask, WIDTH, and the static functions used below.
+// Every operation has to round exactly like its scalar counterpart so that
+// all widths stay bit-identical. That is why sin/cos use our own polynomial
+// instead of the C library, and why the SIMD files build without FMA
+// contraction. Keep everything in here a template: this header is compiled
+// with different instruction sets, and non-template inline functions would
+// be merged across them by the linker.
+namespace agent_kernel {
+
+// Constants for simulation, must match shaders/agents.glsl
+constexpr float RANDOM_TURN = 0.2f;
+constexpr float BASE_SPEED = 100.0f;
+constexpr float SENSOR_ANGLE = 3.1415f / 8.0f;
+constexpr float TURN_SPEED = 0.1f * 3.1415f;
+
+// Cephes-style sinf/cosf: reduce to [-pi/4, pi/4] and pick the polynomial
+// by octant
+template <class Ops>
+void sin_cos(typename Ops::Float x, typename Ops::Float& s, typename Ops::Float& c) {
+    using Float = typename Ops::Float;
+    using Int = typename Ops::Int;
+    using Mask = typename Ops::Mask;
+
+    Mask negative = Ops::lt(x, Ops::set1(0.0f));
+    Float ax = Ops::select(negative, Ops::neg(x), x);
+
+    Int j = Ops::to_int(Ops::mul(ax, Ops::set1(1.27323954473516f)));  // 4 / pi
+    j = Ops::and_int(Ops::add_int(j, Ops::set1_int(1)), Ops::set1_int(~1));
+    Float y = Ops::to_float(j);
+
+    ax = Ops::sub(ax, Ops::mul(y, Ops::set1(0.78515625f)));
+    ax = Ops::sub(ax, Ops::mul(y, Ops::set1(2.4187564849853515625e-4f)));
+    ax = Ops::sub(ax, Ops::mul(y, Ops::set1(3.77489497744594108e-8f)));
+    Float z = Ops::mul(ax, ax);
+
+    Float cosPoly = Ops::add(Ops::mul(Ops::set1(2.443315711809948e-5f), z), Ops::set1(-1.388731625493765e-3f));
+    cosPoly = Ops::add(Ops::mul(cosPoly, z), Ops::set1(4.166664568298827e-2f));
+    cosPoly = Ops::mul(Ops::mul(cosPoly, z), z);
+    cosPoly = Ops::sub(cosPoly, Ops::mul(z, Ops::set1(0.5f)));
+    cosPoly = Ops::add(cosPoly, Ops::set1(1.0f));
+
+    Float sinPoly = Ops::add(Ops::mul(Ops::set1(-1.9515295891e-4f), z), Ops::set1(8.3321608736e-3f));
+    sinPoly = Ops::add(Ops::mul(sinPoly, z), Ops::set1(-1.6666654611e-1f));
+    sinPoly = Ops::mul(Ops::mul(sinPoly, z), ax);
+    sinPoly = Ops::add(sinPoly, ax);
+
+    Int two = Ops::set1_int(2);
+    Int four = Ops::set1_int(4);
+    Mask swap = Ops::eq_int(Ops::and_int(j, two), two);
+    s = Ops::select(swap, cosPoly, sinPoly);
+    c = Ops::select(swap, sinPoly, cosPoly);
+
+    Mask sinFlip = Ops::eq_int(Ops::and_int(j, four), four);
+    s = Ops::select(sinFlip, Ops::neg(s), s);
+    s = Ops::select(negative, Ops::neg(s), s);
+
+    Mask cosFlip = Ops::eq_int(Ops::and_int(Ops::add_int(j, two), four), four);
+    c = Ops::select(cosFlip, Ops::neg(c), c);
+}
+
+// Vector form of philox::philox4x32, one counter per lane. The key is the
+// same for every lane. Only philox.h's constants are used from here: its
+// inline functions aren't templates (see above).
+template <class Ops>
+void philox4x32(typename Ops::Int (&counter)[4], uint32_t key0, uint32_t key1) {
+    using Int = typename Ops::Int;
+    const Int m0 = Ops::set1_int(static_cast<int>(philox::M0));
+    const Int m1 = Ops::set1_int(static_cast<int>(philox::M1));
+    for (int round = 0; round < philox::ROUNDS; ++round) {
+        if (round > 0) {
+            key0 += philox::W0;
+            key1 += philox::W1;
+        }
+        Int high0 = Ops::mul_hi_int(counter[0], m0);
+        Int low0 = Ops::mul_int(counter[0], m0);
+        Int high1 = Ops::mul_hi_int(counter[2], m1);
+        Int low1 = Ops::mul_int(counter[2], m1);
+        counter[0] = Ops::xor_int(Ops::xor_int(high1, counter[1]), Ops::set1_int(static_cast<int>(key0)));
+        counter[1] = low1;
+        counter[2] = Ops::xor_int(Ops::xor_int(high0, counter[3]), Ops::set1_int(static_cast<int>(key1)));
+        counter[3] = low0;
+    }
+}
+
+// v moved onto [0, size) by whole sizes, like GLSL's mod(). Rounding can
+// leave it on size itself or just below zero.
+template <class Ops>
+typename Ops::Float wrap_coordinate(typename Ops::Float v, int size) {
+    using Float = typename Ops::Float;
+    Float extent = Ops::set1(static_cast<float>(size));
+    return Ops::sub(v, Ops::mul(extent, Ops::floor(Ops::mul(v, Ops::set1(1.0f / size)))));
+}
+
+// Pixel column or row under coordinate v, like position_pixel() in
+// shaders/boundary.glsl: clamped onto the edge, or anywhere on the torus
+// when wrapping. The selects take back what wrap_coordinate() rounds over
+// the edge.
+template <class Ops>
+typename Ops::Int position_pixel(typename Ops::Float v, int size, bool wrap) {
+    using Float = typename Ops::Float;
+    if (!wrap) {
+        return Ops::min_int(Ops::max_int(Ops::to_int(Ops::floor(v)), Ops::set1_int(0)), Ops::set1_int(size - 1));
+    }
+    Float extent = Ops::set1(static_cast<float>(size));
+    Float pixel = Ops::floor(wrap_coordinate<Ops>(v, size));
+    pixel = Ops::select(Ops::lt(pixel, Ops::set1(0.0f)), Ops::add(pixel, extent), pixel);
+    pixel = Ops::select(Ops::ge(pixel, extent), Ops::sub(pixel, extent), pixel);
+    return Ops::to_int(pixel);
+}
+
+// Sum of every species' trail weighted by the interaction matrix row of the
+// sensing agent's species, plus the attractor if there is one. No
+// per-species branches, so lanes of different species run the same
+// instructions.
+template <class Ops>
+typename Ops::Float sense(typename Ops::Float x, typename Ops::Float y, typename Ops::Float angle,
+                          typename Ops::Int species, float sensorAngleOffset, const AgentKernelParams& params) {
+    using Float = typename Ops::Float;
+    using Int = typename Ops::Int;
+
+    Float sensorSin, sensorCos;
+    sin_cos<Ops>(Ops::add(angle, Ops::set1(sensorAngleOffset)), sensorSin, sensorCos);
+    Float sensorX = Ops::add(x, Ops::mul(sensorCos, Ops::set1(params.sensorOffset)));
+    Float sensorY = Ops::add(y, Ops::mul(sensorSin, Ops::set1(params.sensorOffset)));
+
+    Int coordX = position_pixel<Ops>(sensorX, params.width, params.wrap);
+    Int coordY = position_pixel<Ops>(sensorY, params.height, params.wrap);
+    Int pixel = Ops::add_int(Ops::mul_int(coordY, Ops::set1_int(params.width)), coordX);
+
+    // The texel of the pyramid level covering the sensor's pixel
+    Int levelX = Ops::min_int(Ops::shift_right(coordX, params.sensorLod), Ops::set1_int(params.levelWidth - 1));
+    Int levelY = Ops::min_int(Ops::shift_right(coordY, params.sensorLod), Ops::set1_int(params.levelHeight - 1));
+    Int index = Ops::mul_int(Ops::add_int(Ops::mul_int(levelY, Ops::set1_int(params.levelWidth)), levelX),
+                             Ops::set1_int(4));
+
+    Float weight = Ops::set1(0.0f);
+    for (int trailSpecies = 0; trailSpecies < params.speciesCount; ++trailSpecies) {
+        const float* channel = params.trailMap + (trailSpecies / 4) * params.layerSize + trailSpecies % 4;
+        Float trail = Ops::gather(channel, index);
+        Float interaction = Ops::gather(params.interactions + trailSpecies * params.speciesCount, species);
+        weight = Ops::add(weight, Ops::mul(interaction, trail));
+    }
+    if (params.attractor) {
+        Float attraction = Ops::gather(params.attractor, pixel);
+        weight = Ops::add(weight, Ops::mul(Ops::set1(params.attractorWeight), attraction));
+    }
+    return weight;
+}
+
+template <class Ops>
+void update_agents(AgentArrays& agents, int begin, int end, const AgentKernelParams& params) {
+    using Float = typename Ops::Float;
+    using Int = typename Ops::Int;
+    using Mask = typename Ops::Mask;
+
+    const Float speed = Ops::set1(BASE_SPEED * params.deltaTime);
+    const Float zero = Ops::set1(0.0f);
+    const Float width = Ops::set1(static_cast<float>(params.width));
+    const Float height = Ops::set1(static_cast<float>(params.height));
+    const Float maxX = Ops::set1(static_cast<float>(params.width - 1));
+    const Float maxY = Ops::set1(static_cast<float>(params.height - 1));
+    const Int step = Ops::set1_int(static_cast<int>(params.step));
+    const Int steerStream = Ops::set1_int(philox::STREAM_STEER);
+
+    for (int i = begin; i < end; i += Ops::WIDTH) {
+        Float x = Ops::load(agents.x + i);
+        Float y = Ops::load(agents.y + i);
+        Float angle = Ops::load(agents.angle + i);
+        Int species = Ops::load_int(agents.species + i);
+
+        Int random[4] = {Ops::index(i), step, steerStream, Ops::set1_int(0)};
+        philox4x32<Ops>(random, params.seed, 0);
+
+        Float weightForward = sense<Ops>(x, y, angle, species, 0.0f, params);
+        Float weightLeft = sense<Ops>(x, y, angle, species, SENSOR_ANGLE, params);
+        Float weightRight = sense<Ops>(x, y, angle, species, -SENSOR_ANGLE, params);
+
+        // random_unit(bits) + 0.2, from .2 to 1.2
+        Float randomUnit = Ops::mul(Ops::to_float(Ops::shift_right(random[0], 8)), Ops::set1(1.0f / 16777216.0f));
+        Float randomSteerStrength = Ops::add(randomUnit, Ops::set1(0.2f));
+
+        // Straight if forward wins, otherwise turn towards the stronger side
+        Mask straight = Ops::and_mask(Ops::gt(weightForward, weightLeft), Ops::gt(weightForward, weightRight));
+        Mask left = Ops::gt(weightLeft, weightRight);
+        Float turn = Ops::mul(randomSteerStrength, Ops::set1(TURN_SPEED));
+        Float turned = Ops::select(left, Ops::add(angle, turn), Ops::sub(angle, turn));
+        angle = Ops::select(straight, angle, turned);
+
+        // The obstacle field at the agent's pixel before it moves, see
+        // obstacles.h. Positions are brought onto the grid at the end of
+        // every step but not yet on the first one.
+        Float wallDistance = zero, wallX = zero, wallY = zero, wallAngle = zero;
+        if (params.obstacles) {
+            Int pixelX = position_pixel<Ops>(x, params.width, params.wrap);
+            Int pixelY = position_pixel<Ops>(y, params.height, params.wrap);
+            Int texel =
+                Ops::mul_int(Ops::add_int(Ops::mul_int(pixelY, Ops::set1_int(params.width)), pixelX), Ops::set1_int(4));
+            wallDistance = Ops::gather(params.obstacles, texel);
+            wallX = Ops::gather(params.obstacles + 1, texel);
+            wallY = Ops::gather(params.obstacles + 2, texel);
+            wallAngle = Ops::gather(params.obstacles + 3, texel);
+        }
+
+        Float moveSin, moveCos;
+        sin_cos<Ops>(angle, moveSin, moveCos);
+        x = Ops::add(x, Ops::mul(moveCos, speed));
+        y = Ops::add(y, Ops::mul(moveSin, speed));
+
+        // bounceOffObstacles. The distance after the move is exact for
+        // straight walls. Crossing one mirrors the agent back across it, and
+        // heading into one within sensor reach turns it away by a steer.
+        if (params.obstacles) {
+            Float facing = Ops::add(Ops::mul(moveCos, wallX), Ops::mul(moveSin, wallY));
+            Float distance = Ops::add(wallDistance, Ops::mul(speed, facing));
+            Mask inside = Ops::lt(distance, zero);
+            Float push = Ops::mul(distance, Ops::set1(-2.0f));
+            x = Ops::select(inside, Ops::add(x, Ops::mul(push, wallX)), x);
+            y = Ops::select(inside, Ops::add(y, Ops::mul(push, wallY)), y);
+            Float reflected = Ops::sub(Ops::add(Ops::add(wallAngle, wallAngle), Ops::set1(3.1415f)), angle);
+
+            Mask approaching = Ops::and_mask(Ops::lt(distance, Ops::set1(params.sensorOffset)), Ops::lt(facing, zero));
+            Float across = Ops::sub(Ops::mul(moveCos, wallY), Ops::mul(moveSin, wallX));
+            Float away = Ops::select(Ops::ge(across, zero), Ops::add(angle, turn), Ops::sub(angle, turn));
+            angle = Ops::select(inside, reflected, Ops::select(approaching, away, angle));
+        }
+
+        angle = Ops::add(angle, Ops::mul(randomSteerStrength, Ops::set1(RANDOM_TURN)));
+
+        if (params.wrap) {
+            // Out over one edge, back in over the opposite one
+            x = wrap_coordinate<Ops>(x, params.width);
+            y = wrap_coordinate<Ops>(y, params.height);
+        } else {
+            // bounceOffWalls
+            Mask hitX = Ops::or_mask(Ops::le(x, zero), Ops::ge(x, width));
+            angle = Ops::select(hitX, Ops::sub(Ops::set1(3.1415f), angle), angle);
+            Mask hitY = Ops::or_mask(Ops::le(y, zero), Ops::ge(y, height));
+            angle = Ops::select(hitY, Ops::neg(angle), angle);
+
+            x = Ops::min(Ops::max(x, zero), maxX);
+            y = Ops::min(Ops::max(y, zero), maxY);
+        }
+
+        Ops::store(agents.x + i, x);
+        Ops::store(agents.y + i, y);
+        Ops::store(agents.angle + i, angle);
+    }
+}
+
+}
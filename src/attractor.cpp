@@ -0,0 +1,69 @@
+#include "attractor.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+bool load_attractor(const std::string& filename, AttractorImage& image) {
+    bool wide = stbi_is_16_bit(filename.c_str()) != 0;
+    int channels;
+    void* data = wide ? static_cast<void*>(stbi_load_16(filename.c_str(), &image.width, &image.height, &channels, 1))
+                      : static_cast<void*>(stbi_load(filename.c_str(), &image.width, &image.height, &channels, 1));
+    if (!data) {
+        std::cerr << "Failed to load attractor image " << filename << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+
+    // stb_image starts at the top row
+    image.bytesPerPixel = wide ? 2 : 1;
+    size_t rowBytes = static_cast<size_t>(image.width) * image.bytesPerPixel;
+    image.pixels.resize(rowBytes * image.height);
+    for (int y = 0; y < image.height; ++y) {
+        std::memcpy(&image.pixels[y * rowBytes], static_cast<unsigned char*>(data) + (image.height - 1 - y) * rowBytes,
+                    rowBytes);
+    }
+    stbi_image_free(data);
+    return true;
+}
+
+std::vector<float> resample_attractor(const AttractorImage& image, int width, int height, ThreadPool& pool) {
+    const float scale = image.bytesPerPixel == 2 ? 1.0f / 65535.0f : 1.0f / 255.0f;
+    auto pixel = [&](int x, int y) -> float {
+        size_t i = static_cast<size_t>(y) * image.width + x;
+        if (image.bytesPerPixel == 2) {
+            uint16_t value;
+            std::memcpy(&value, &image.pixels[i * 2], sizeof(value));
+            return value;
+        }
+        return image.pixels[i];
+    };
+
+    // Image pixels [begin, end) under grid pixel i of count, at least one
+    // so grids larger than the image repeat its pixels
+    auto footprint = [](int i, int count, int size, int& begin, int& end) {
+        begin = static_cast<int>(static_cast<int64_t>(i) * size / count);
+        end = std::max(static_cast<int>(static_cast<int64_t>(i + 1) * size / count), begin + 1);
+    };
+
+    std::vector<float> field(static_cast<size_t>(width) * height);
+    pool.parallel_for(0, height, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            int y0, y1;
+            footprint(y, height, image.height, y0, y1);
+            for (int x = 0; x < width; ++x) {
+                int x0, x1;
+                footprint(x, width, image.width, x0, x1);
+                float sum = 0.0f;
+                for (int imageY = y0; imageY < y1; ++imageY) {
+                    for (int imageX = x0; imageX < x1; ++imageX) {
+                        sum += pixel(imageX, imageY);
+                    }
+                }
+                field[static_cast<size_t>(y) * width + x] = sum * scale / ((x1 - x0) * (y1 - y0));
+            }
+        }
+    });
+    return field;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "thread_pool.h"
+
+#include <string>
+#include <vector>
+
+// Static chemoattractant or food map that every species senses on top of
+// the trail, scaled by settings.attractorWeight. Brightness is attraction,
+// so a portrait gets traced by the agents. Grey, 8 or 16 bits as stored in
+// the file, rows bottom-up like the grid. The GL side uploads it as is into
+// an R8 or R16 texture with mipmaps; the image keeps its own size there and
+// the sensor picks the mip level that matches one grid pixel.
+struct AttractorImage {
+    int width = 0;
+    int height = 0;
+    int bytesPerPixel = 1;  // 1 or 2
+    std::vector<unsigned char> pixels;
+};
+
+// Reads any format stb_image does and converts it to grey. Prints a message
+// and returns false if the file can't be read.
+bool load_attractor(const std::string& filename, AttractorImage& image);
+
+// The image over a width x height grid in [0, 1] for the CPU backend, one
+// float per pixel. Each grid pixel averages the image pixels it covers, like
+// the mip level the GL sensors read.
+std::vector<float> resample_attractor(const AttractorImage& image, int width, int height, ThreadPool& pool);
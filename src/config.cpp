@@ -1,3 +1 @@
-#include "config.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
\ No newline at end of file
+#include "config.h"
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "cpu_features.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+
+#ifdef _MSC_VER
+bool os_saves_avx_state(unsigned long long mask) {
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    return osxsave && (_xgetbv(0) & mask) == mask;
+}
+
+bool has_avx2() {
+    int info[4];
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0 && os_saves_avx_state(0x6);
+}
+
+bool has_avx512f() {
+    int info[4];
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 16)) != 0 && os_saves_avx_state(0xE6);
+}
+#else
+bool has_avx2() {
+    return __builtin_cpu_supports("avx2");
+}
+
+bool has_avx512f() {
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+}
+
+SimdLevel detect_simd_level() {
+    if (has_avx512f()) {
+        return SimdLevel::Avx512;
+    }
+    if (has_avx2()) {
+        return SimdLevel::Avx2;
+    }
+    return SimdLevel::Scalar;
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Auto: return "auto";
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::Avx2: return "avx2";
+        case SimdLevel::Avx512: return "avx512";
+    }
+    return "unknown";
+}
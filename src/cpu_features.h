@@ -0,0 +1,14 @@
+#pragma once
+
+// Instruction sets the CPU agent kernel is built for
+enum class SimdLevel {
+    Auto,
+    Scalar,
+    Avx2,
+    Avx512
+};
+
+// Widest level this CPU and OS support
+SimdLevel detect_simd_level();
+
+const char* simd_level_name(SimdLevel level);
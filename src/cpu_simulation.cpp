@@ -0,0 +1,579 @@
+#include "cpu_simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <immintrin.h>
+#include <utility>
+
+namespace {
+
+// Must match shaders/diffusion_shader.glsl
+const float DECAY_RATE = 0.4f;
+const float DIFFUSE_WEIGHT = 0.1f;
+const float DEPOSIT_AMOUNT = 1.0f;
+const uint32_t DEPOSIT_ONE = 256;  // Fixed point, see shaders/deposits.glsl
+
+// Side of the square tiles whose activity is tracked
+const int ACTIVITY_TILE_SIZE = 64;
+
+// Width or height of a mip level, as GL sizes them
+int level_size(int size, int level) {
+    return std::max(size >> level, 1);
+}
+
+// v on a torus of size, for v at most one size outside [0, size)
+int wrap_index(int v, int size) {
+    return v < 0 ? v + size : v >= size ? v - size : v;
+}
+
+// Largest radius blurred with direct taps. Running sums cost about as much
+// as radius 2 at any radius, so they take over from there on.
+const int DIRECT_MAX_RADIUS = 2;
+
+// Mixes a pixel with its blurred neighbourhood, decays it down to zero and
+// adds its deposits, which it then clears. One RGBA pixel of a layer per
+// SSE register. Channels past the last species are blurred but not
+// decayed, same as the shader.
+struct DiffuseBlend {
+    DiffuseBlend(float deltaTime, int channels)
+        : weight(_mm_set1_ps(DIFFUSE_WEIGHT)),
+          keep(_mm_set1_ps(1.0f - DIFFUSE_WEIGHT)),
+          decay(_mm_setr_ps(channels > 0 ? deltaTime * DECAY_RATE : 0.0f, channels > 1 ? deltaTime * DECAY_RATE : 0.0f,
+                            channels > 2 ? deltaTime * DECAY_RATE : 0.0f, channels > 3 ? deltaTime * DECAY_RATE : 0.0f)),
+          amount(_mm_set1_ps(DEPOSIT_AMOUNT / DEPOSIT_ONE)) {}
+
+    // Returns whether any channel of the result is above zero
+    bool store(const float* current, float* out, uint32_t* deposits, __m128 sum, int count) const {
+        __m128 average = _mm_div_ps(sum, _mm_set1_ps(static_cast<float>(count)));
+        __m128 mixed = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(current), keep), _mm_mul_ps(average, weight));
+        __m128 decayed = _mm_max_ps(_mm_sub_ps(mixed, decay), _mm_setzero_ps());
+        __m128i counts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(deposits));
+        __m128 result = _mm_add_ps(decayed, _mm_mul_ps(_mm_cvtepi32_ps(counts), amount));
+        _mm_storeu_ps(out, result);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(deposits), _mm_setzero_si128());
+        return _mm_movemask_ps(_mm_cmpgt_ps(result, _mm_setzero_ps())) != 0;
+    }
+
+    __m128 weight, keep, decay, amount;
+};
+
+}
+
+CpuSimulation::CpuSimulation(const Settings& settings, const std::vector<float>& interactions,
+                             const SpawnImage& spawnImage, ObstacleField obstacles, const AttractorImage& attractor)
+    : width(settings.width), height(settings.height), wrap(settings.boundary == BoundaryMode::Wrap),
+      radius(settings.diffusionRadius),
+      speciesCount(settings.numSpecies), layers((settings.numSpecies + 3) / 4), seed(settings.seed),
+      pool(settings.threads), obstacles(std::move(obstacles.texels)), attractorWeight(settings.attractorWeight),
+      sensorOffset(settings.sensorOffset), sensorLod(sensor_lod(settings.sensorOffset, width, height)),
+      depositMode(settings.deposit) {
+    updateAgents = select_agent_kernel(settings.simd, simdLevel);
+
+    if (!attractor.pixels.empty()) {
+        this->attractor = resample_attractor(attractor, width, height, pool);
+    }
+
+    interactionsByTrail.resize(interactions.size());
+    for (int sensing = 0; sensing < speciesCount; ++sensing) {
+        for (int trail = 0; trail < speciesCount; ++trail) {
+            interactionsByTrail[trail * speciesCount + sensing] = interactions[sensing * speciesCount + trail];
+        }
+    }
+
+    // The spawn pass of main.cpp, so both start from the same agents for a
+    // seed. Each agent only depends on its index.
+    agents.resize(settings.numAgents);
+    pool.parallel_for(0, settings.numAgents, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            agents.set(i, spawn_agent(settings.spawn, seed, i, width, height, speciesCount, spawnImage));
+        }
+    });
+
+    trailMap.assign(layer_size() * layers, 0.0f);
+    diffusedTrailMap.assign(trailMap.size(), 0.0f);
+    deposits.assign(trailMap.size(), 0);
+    for (int level = 1; level <= sensorLod; ++level) {
+        size_t levelPixels = static_cast<size_t>(level_size(width, level)) * level_size(height, level);
+        trailPyramid.emplace_back(levelPixels * 4 * layers, 0.0f);
+    }
+
+    tilesX = (width + ACTIVITY_TILE_SIZE - 1) / ACTIVITY_TILE_SIZE;
+    tilesY = (height + ACTIVITY_TILE_SIZE - 1) / ACTIVITY_TILE_SIZE;
+    agentTiles.assign(tilesX * tilesY, 0);
+    trailTiles.assign(tilesX * tilesY, 0);
+    previousTrailTiles.assign(tilesX * tilesY, 0);
+    activeTiles.assign(tilesX * tilesY, 0);
+    rowTrail.assign(static_cast<size_t>(height) * tilesX, 0);
+    for (unsigned thread = 1; thread < pool.size(); ++thread) {
+        threadDeposits.emplace_back(deposits.size(), 0);
+        threadTiles.emplace_back(agentTiles.size(), 0);
+    }
+}
+
+void CpuSimulation::step(float deltaTime) {
+    // Same pass order as main.cpp: agents sense frame N and count their
+    // deposits, then frame N is blurred and decayed into frame N+1 and the
+    // deposits are added
+    AgentKernelParams params;
+    params.sensorLod = sensorLod;
+    params.levelWidth = level_size(width, sensorLod);
+    params.levelHeight = level_size(height, sensorLod);
+    params.trailMap = sensorLod == 0 ? trailMap.data() : trailPyramid[sensorLod - 1].data();
+    params.layerSize = static_cast<size_t>(params.levelWidth) * params.levelHeight * 4;
+    params.sensorOffset = sensorOffset;
+    params.speciesCount = speciesCount;
+    params.interactions = interactionsByTrail.data();
+    params.obstacles = obstacles.empty() ? nullptr : obstacles.data();
+    params.attractor = attractor.empty() ? nullptr : attractor.data();
+    params.attractorWeight = attractorWeight;
+    params.width = width;
+    params.height = height;
+    params.wrap = wrap;
+    params.deltaTime = deltaTime;
+    params.seed = seed;
+    params.step = stepIndex;
+
+    // Hand out whole vectors so no two threads share one
+    const int lanes = AgentArrays::LANES;
+    pool.parallel_for(0, agents.padded_size() / lanes, [&](int begin, int end) {
+        updateAgents(agents, begin * lanes, end * lanes, params);
+    });
+
+    deposit();
+    update_active_tiles();
+
+    pool.parallel_for(0, height, [&](int begin, int end) {
+        diffuse_rows(begin, end, deltaTime);
+    });
+
+    update_trail_tiles();
+    trailMap.swap(diffusedTrailMap);
+    build_trail_pyramid();
+    ++stepIndex;
+}
+
+float CpuSimulation::check_diffusion(float deltaTime) {
+    // The kernel leaves inactive tiles holding what diffusedTrailMap had,
+    // which is zero there, so the reference starts from the same copy
+    std::vector<float> previous = diffusedTrailMap;
+    std::vector<uint8_t> previousRowTrail = rowTrail;
+    float previousFraction = activeTileFraction;
+
+    update_active_tiles();
+    pool.parallel_for(0, height, [&](int begin, int end) {
+        diffuse_rows(begin, end, deltaTime);
+    });
+    std::vector<float> kernel = diffusedTrailMap;
+
+    diffusedTrailMap = previous;
+    pool.parallel_for(0, height, [&](int begin, int end) {
+        for (int layer = 0; layer < layers; ++layer) {
+            diffuse_rows_reference(begin, end, deltaTime, layer);
+        }
+    });
+    float error = 0.0f;
+    for (size_t i = 0; i < kernel.size(); ++i) {
+        error = std::max(error, std::abs(kernel[i] - diffusedTrailMap[i]));
+    }
+
+    diffusedTrailMap.swap(previous);
+    rowTrail.swap(previousRowTrail);
+    activeTileFraction = previousFraction;
+    return error;
+}
+
+void CpuSimulation::build_trail_pyramid() {
+    // Each texel averages the 2x2 below it, like glGenerateMipmap. Odd
+    // sizes drop the last row or column.
+    for (int level = 1; level <= sensorLod; ++level) {
+        const float* source = level == 1 ? trailMap.data() : trailPyramid[level - 2].data();
+        float* target = trailPyramid[level - 1].data();
+        int sourceWidth = level_size(width, level - 1), sourceHeight = level_size(height, level - 1);
+        int targetWidth = level_size(width, level), targetHeight = level_size(height, level);
+        size_t sourceLayer = static_cast<size_t>(sourceWidth) * sourceHeight * 4;
+        size_t targetLayer = static_cast<size_t>(targetWidth) * targetHeight * 4;
+        pool.parallel_for(0, targetHeight * layers, [&](int begin, int end) {
+            for (int row = begin; row < end; ++row) {
+                int layer = row / targetHeight, y = row % targetHeight;
+                const float* below = source + layer * sourceLayer + static_cast<size_t>(2 * y) * sourceWidth * 4;
+                const float* above = below + (sourceHeight > 1 ? sourceWidth * 4 : 0);
+                float* out = target + layer * targetLayer + static_cast<size_t>(y) * targetWidth * 4;
+                int step = sourceWidth > 1 ? 4 : 0;
+                for (int x = 0; x < targetWidth; ++x) {
+                    for (int channel = 0; channel < 4; ++channel) {
+                        size_t i = static_cast<size_t>(2 * x) * 4 + channel;
+                        out[x * 4 + channel] = (below[i] + below[i + step] + above[i] + above[i + step]) * 0.25f;
+                    }
+                }
+            }
+        });
+    }
+}
+
+void CpuSimulation::deposit() {
+    // Integer counts like the imageAtomicAdd in agents.glsl, so the result
+    // doesn't depend on the order agents are visited in
+    const int threads = static_cast<int>(threadDeposits.size()) + 1;
+    const int count = agents.size();
+    pool.parallel_for(0, threads, [&](int begin, int end) {
+        for (int thread = begin; thread < end; ++thread) {
+            uint32_t* counts = thread == 0 ? deposits.data() : threadDeposits[thread - 1].data();
+            uint8_t* tiles = thread == 0 ? agentTiles.data() : threadTiles[thread - 1].data();
+            auto channel = [&](int species) { return counts + species / 4 * layer_size() + species % 4; };
+            auto mark = [&](int x, int y) { tiles[y / ACTIVITY_TILE_SIZE * tilesX + x / ACTIVITY_TILE_SIZE] = 1; };
+
+            int first = static_cast<int>(static_cast<int64_t>(count) * thread / threads);
+            int last = static_cast<int>(static_cast<int64_t>(count) * (thread + 1) / threads);
+            for (int i = first; i < last; ++i) {
+                uint32_t* layer = channel(agents.species[i]);
+                if (depositMode != DepositMode::Bilinear) {  // Raster only differs in how GL adds it
+                    int x = static_cast<int>(agents.x[i]), y = static_cast<int>(agents.y[i]);
+                    if (wrap) {
+                        // Wrapping can round a position onto the far edge
+                        x = wrap_index(x, width);
+                        y = wrap_index(y, height);
+                    }
+                    layer[(static_cast<size_t>(y) * width + x) * 4] += DEPOSIT_ONE;
+                    mark(x, y);
+                    continue;
+                }
+
+                // The splat in agents.glsl: sixteenths of a pixel towards
+                // the far neighbours, clamped onto the edge pixels or
+                // wrapped. Zero weights add nothing, so they need no test.
+                float splatX = agents.x[i] - 0.5f, splatY = agents.y[i] - 0.5f;
+                int cornerX = static_cast<int>(std::floor(splatX)), cornerY = static_cast<int>(std::floor(splatY));
+                uint32_t farX = static_cast<uint32_t>((splatX - cornerX) * 16.0f + 0.5f);
+                uint32_t farY = static_cast<uint32_t>((splatY - cornerY) * 16.0f + 0.5f);
+                int x0 = std::max(cornerX, 0), x1 = std::min(cornerX + 1, width - 1);
+                int y0 = std::max(cornerY, 0), y1 = std::min(cornerY + 1, height - 1);
+                if (wrap) {
+                    x0 = wrap_index(cornerX, width);
+                    x1 = wrap_index(cornerX + 1, width);
+                    y0 = wrap_index(cornerY, height);
+                    y1 = wrap_index(cornerY + 1, height);
+                }
+                uint32_t* row0 = layer + static_cast<size_t>(y0) * width * 4;
+                uint32_t* row1 = layer + static_cast<size_t>(y1) * width * 4;
+                row0[x0 * 4] += (16 - farX) * (16 - farY);
+                row0[x1 * 4] += farX * (16 - farY);
+                row1[x0 * 4] += (16 - farX) * farY;
+                row1[x1 * 4] += farX * farY;
+                mark(x0, y0);
+                mark(x1, y1);
+                mark(x0, y1);
+                mark(x1, y0);
+            }
+        }
+    });
+    if (threads == 1) {
+        return;
+    }
+
+    // Sum the other threads' counts in, one tile row per task
+    pool.parallel_for(0, tilesY, [&](int begin, int end) {
+        for (int ty = begin; ty < end; ++ty) {
+            int rowEnd = std::min((ty + 1) * ACTIVITY_TILE_SIZE, height);
+            for (int thread = 0; thread < threads - 1; ++thread) {
+                for (int tx = 0; tx < tilesX; ++tx) {
+                    uint8_t& touched = threadTiles[thread][ty * tilesX + tx];
+                    if (!touched) {
+                        continue;
+                    }
+                    touched = 0;
+                    agentTiles[ty * tilesX + tx] = 1;
+                    size_t spanBegin = static_cast<size_t>(tx) * ACTIVITY_TILE_SIZE * 4;
+                    size_t spanEnd = static_cast<size_t>(std::min((tx + 1) * ACTIVITY_TILE_SIZE, width)) * 4;
+                    for (int layer = 0; layer < layers; ++layer) {
+                        for (int y = ty * ACTIVITY_TILE_SIZE; y < rowEnd; ++y) {
+                            size_t row = layer * layer_size() + static_cast<size_t>(y) * width * 4;
+                            uint32_t* source = threadDeposits[thread].data() + row;
+                            uint32_t* target = deposits.data() + row;
+                            for (size_t i = spanBegin; i < spanEnd; ++i) {
+                                target[i] += source[i];
+                                source[i] = 0;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+void CpuSimulation::update_active_tiles() {
+    // Trail spreads at most radius pixels per step, so tiles further than
+    // that from any trail blur to zero. On the torus that reach continues
+    // across the seam, where the last tile of a row or column can be
+    // narrower than the others, so there it takes one tile more.
+    int reach = (radius + ACTIVITY_TILE_SIZE - 1) / ACTIVITY_TILE_SIZE;
+    int span = wrap ? reach + 1 : reach;
+    // Whether the tile offset from tile reaches it, and which one it is
+    auto neighbour = [&](int tile, int offset, int count, int& index) {
+        index = tile + offset;
+        bool seam = index < 0 || index >= count;
+        index = (index % count + count) % count;
+        return wrap ? std::abs(offset) <= reach || seam : !seam;
+    };
+    int activeCount = 0;
+    for (int ty = 0; ty < tilesY; ++ty) {
+        for (int tx = 0; tx < tilesX; ++tx) {
+            int tile = ty * tilesX + tx;
+            bool active = agentTiles[tile] || previousTrailTiles[tile];
+            for (int dy = -span; dy <= span && !active; ++dy) {
+                int y;
+                if (!neighbour(ty, dy, tilesY, y)) {
+                    continue;
+                }
+                for (int dx = -span; dx <= span && !active; ++dx) {
+                    int x;
+                    if (neighbour(tx, dx, tilesX, x)) {
+                        active = trailTiles[y * tilesX + x] != 0;
+                    }
+                }
+            }
+            activeTiles[tile] = active;
+            activeCount += active;
+        }
+    }
+    activeTileFraction = static_cast<float>(activeCount) / (tilesX * tilesY);
+    std::fill(agentTiles.begin(), agentTiles.end(), 0);
+}
+
+void CpuSimulation::update_trail_tiles() {
+    // diffusedTrailMap becomes trailMap, and trailMap keeps what it holds
+    // until it is written again
+    previousTrailTiles.swap(trailTiles);
+    for (int ty = 0; ty < tilesY; ++ty) {
+        int rowEnd = std::min((ty + 1) * ACTIVITY_TILE_SIZE, height);
+        for (int tx = 0; tx < tilesX; ++tx) {
+            bool trail = false;
+            if (activeTiles[ty * tilesX + tx]) {
+                for (int y = ty * ACTIVITY_TILE_SIZE; y < rowEnd && !trail; ++y) {
+                    trail = rowTrail[static_cast<size_t>(y) * tilesX + tx] != 0;
+                }
+            }
+            trailTiles[ty * tilesX + tx] = trail;
+        }
+    }
+}
+
+template <typename Span>
+void CpuSimulation::for_each_active_span(int y, Span span) const {
+    const uint8_t* tiles = &activeTiles[y / ACTIVITY_TILE_SIZE * tilesX];
+    for (int tx = 0; tx < tilesX;) {
+        if (!tiles[tx]) {
+            ++tx;
+            continue;
+        }
+        int first = tx;
+        while (tx < tilesX && tiles[tx]) {
+            ++tx;
+        }
+        span(first * ACTIVITY_TILE_SIZE, std::min(tx * ACTIVITY_TILE_SIZE, width));
+    }
+}
+
+void CpuSimulation::diffuse_rows(int begin, int end, float deltaTime) {
+    // Layers blur independently and each ORs into rowTrail. Direct taps get
+    // a compile-time radius so the window loops unroll.
+    std::fill(rowTrail.begin() + static_cast<size_t>(begin) * tilesX, rowTrail.begin() + static_cast<size_t>(end) * tilesX, 0);
+    for (int layer = 0; layer < layers; ++layer) {
+        switch (radius) {
+            case 0: diffuse_rows_direct<0>(begin, end, deltaTime, layer); break;
+            case 1: diffuse_rows_direct<1>(begin, end, deltaTime, layer); break;
+            case 2: diffuse_rows_direct<2>(begin, end, deltaTime, layer); break;
+            default: diffuse_rows_running_sum(begin, end, deltaTime, layer); break;
+        }
+    }
+    static_assert(DIRECT_MAX_RADIUS == 2, "diffuse_rows needs a case per direct radius");
+}
+
+template <int Radius>
+void CpuSimulation::diffuse_rows_direct(int begin, int end, float deltaTime, int layer) {
+    // The box blur is separable: vertical sums of each column, then a
+    // horizontal window over those. The window's column sums shift along
+    // with x, which stays in registers once the loops are unrolled.
+    const int WINDOW_SIZE = 2 * Radius + 1;
+    const DiffuseBlend blend(deltaTime, speciesCount - layer * 4);
+    const size_t layerOffset = layer * layer_size();
+    const float* src = trailMap.data() + layerOffset;
+    float* dst = diffusedTrailMap.data() + layerOffset;
+    uint32_t* layerDeposits = deposits.data() + layerOffset;
+    const size_t rowFloats = static_cast<size_t>(width) * 4;
+    __m128 window[WINDOW_SIZE];
+
+    for (int y = begin; y < end; ++y) {
+        // Neighbours outside the map are skipped, so the count is the rows
+        // in bounds times the columns in bounds. On the torus they are all
+        // there.
+        int rows[WINDOW_SIZE];
+        int rowCount = 0;
+        for (int row = y - Radius; row <= y + Radius; ++row) {
+            if (wrap) {
+                rows[rowCount++] = wrap_index(row, height);
+            } else if (row >= 0 && row < height) {
+                rows[rowCount++] = row;
+            }
+        }
+        uint8_t* trail = &rowTrail[static_cast<size_t>(y) * tilesX];
+
+        auto column_sum = [&](int x) {
+            if (wrap) {
+                x = wrap_index(x, width);
+            } else if (x < 0 || x >= width) {
+                return _mm_setzero_ps();
+            }
+            __m128 sum = _mm_setzero_ps();
+            for (int i = 0; i < rowCount; ++i) {
+                sum = _mm_add_ps(sum, _mm_loadu_ps(src + rows[i] * rowFloats + x * 4));
+            }
+            return sum;
+        };
+
+        for_each_active_span(y, [&](int first, int last) {
+            for (int i = 0; i < WINDOW_SIZE - 1; ++i) {
+                window[i + 1] = column_sum(first + i - Radius);
+            }
+
+            for (int x = first; x < last; ++x) {
+                for (int i = 0; i < WINDOW_SIZE - 1; ++i) {
+                    window[i] = window[i + 1];
+                }
+                window[WINDOW_SIZE - 1] = column_sum(x + Radius);
+
+                // Summed oldest to newest
+                __m128 sum = window[0];
+                for (int i = 1; i < WINDOW_SIZE; ++i) {
+                    sum = _mm_add_ps(sum, window[i]);
+                }
+
+                int columnCount =
+                    wrap ? WINDOW_SIZE : std::min(x + Radius, width - 1) - std::max(x - Radius, 0) + 1;
+                size_t index = y * rowFloats + x * 4;
+                if (blend.store(src + index, dst + index, layerDeposits + index, sum, rowCount * columnCount)) {
+                    trail[x / ACTIVITY_TILE_SIZE] = 1;
+                }
+            }
+        });
+    }
+}
+
+void CpuSimulation::diffuse_rows_running_sum(int begin, int end, float deltaTime, int layer) {
+    // Same separable blur, but both directions keep running sums: the column
+    // sums carry over from the previous row and the window over them slides
+    // along the row, adding what enters and dropping what leaves. The cost
+    // per pixel doesn't depend on the radius.
+    const DiffuseBlend blend(deltaTime, speciesCount - layer * 4);
+    const size_t layerOffset = layer * layer_size();
+    const float* src = trailMap.data() + layerOffset;
+    float* dst = diffusedTrailMap.data() + layerOffset;
+    uint32_t* layerDeposits = deposits.data() + layerOffset;
+    const size_t rowFloats = static_cast<size_t>(width) * 4;
+
+    // Sums of columns [-margin, width + margin), so on the torus the
+    // window's columns past either edge have their own, wrapped ones
+    const int margin = wrap ? radius + 1 : 0;
+    std::vector<float> columnSums((static_cast<size_t>(width) + 2 * margin) * 4, 0.0f);
+    auto column = [&](int x) { return &columnSums[static_cast<size_t>(x + margin) * 4]; };
+    auto add_row = [&](int row, int first, int last, bool subtract) {
+        const float* pixels = src + (wrap ? wrap_index(row, height) : row) * rowFloats;
+        for (int x = first; x < last; ++x) {
+            __m128 sum = _mm_loadu_ps(column(x));
+            __m128 value = _mm_loadu_ps(pixels + (wrap ? wrap_index(x, width) : x) * 4);
+            _mm_storeu_ps(column(x), subtract ? _mm_sub_ps(sum, value) : _mm_add_ps(sum, value));
+        }
+    };
+
+    // Column sums only cover the active spans of a tile row and their
+    // margins, so they start over at each tile row. They start from its
+    // first row even when the chunk begins further down, so every row is
+    // summed in the same order whatever the thread split.
+    for (int bandBegin = begin; bandBegin < end;) {
+        int tileRowBegin = bandBegin / ACTIVITY_TILE_SIZE * ACTIVITY_TILE_SIZE;
+        int bandEnd = std::min(tileRowBegin + ACTIVITY_TILE_SIZE, end);
+
+        for_each_active_span(bandBegin, [&](int first, int last) {
+            int columnFirst = wrap ? first - radius : std::max(first - radius, 0);
+            int columnLast = wrap ? last + radius : std::min(last + radius, width);
+            std::fill(column(columnFirst), column(columnLast), 0.0f);
+            // Includes the row the first step drops
+            int rowFirst = wrap ? tileRowBegin - radius - 1 : std::max(tileRowBegin - radius - 1, 0);
+            int rowLast = wrap ? tileRowBegin + radius : std::min(tileRowBegin + radius, height);
+            for (int row = rowFirst; row < rowLast; ++row) {
+                add_row(row, columnFirst, columnLast, false);
+            }
+
+            for (int y = tileRowBegin; y < bandEnd; ++y) {
+                if (wrap || y + radius < height) {
+                    add_row(y + radius, columnFirst, columnLast, false);
+                }
+                if (wrap || y - radius - 1 >= 0) {
+                    add_row(y - radius - 1, columnFirst, columnLast, true);
+                }
+                // Rows before the chunk only bring the column sums along
+                if (y < bandBegin) {
+                    continue;
+                }
+                int rowCount = wrap ? 2 * radius + 1 : std::min(y + radius, height - 1) - std::max(y - radius, 0) + 1;
+                uint8_t* trail = &rowTrail[static_cast<size_t>(y) * tilesX];
+
+                // Starts out holding the column the first step drops
+                __m128 sum = _mm_setzero_ps();
+                int windowFirst = wrap ? first - radius - 1 : std::max(first - radius - 1, 0);
+                int windowLast = wrap ? first + radius : std::min(first + radius, width);
+                for (int x = windowFirst; x < windowLast; ++x) {
+                    sum = _mm_add_ps(sum, _mm_loadu_ps(column(x)));
+                }
+                for (int x = first; x < last; ++x) {
+                    if (wrap || x + radius < width) {
+                        sum = _mm_add_ps(sum, _mm_loadu_ps(column(x + radius)));
+                    }
+                    if (wrap || x - radius - 1 >= 0) {
+                        sum = _mm_sub_ps(sum, _mm_loadu_ps(column(x - radius - 1)));
+                    }
+
+                    int columnCount =
+                        wrap ? 2 * radius + 1 : std::min(x + radius, width - 1) - std::max(x - radius, 0) + 1;
+                    size_t index = y * rowFloats + x * 4;
+                    if (blend.store(src + index, dst + index, layerDeposits + index, sum, rowCount * columnCount)) {
+                        trail[x / ACTIVITY_TILE_SIZE] = 1;
+                    }
+                }
+            }
+        });
+
+        bandBegin = bandEnd;
+    }
+}
+
+void CpuSimulation::diffuse_rows_reference(int begin, int end, float deltaTime, int layer) {
+    // Every pixel sums its own neighbourhood, nothing is shared or skipped
+    const DiffuseBlend blend(deltaTime, speciesCount - layer * 4);
+    const size_t layerOffset = layer * layer_size();
+    const float* src = trailMap.data() + layerOffset;
+    float* dst = diffusedTrailMap.data() + layerOffset;
+    uint32_t* layerDeposits = deposits.data() + layerOffset;
+    const size_t rowFloats = static_cast<size_t>(width) * 4;
+
+    for (int y = begin; y < end; ++y) {
+        for (int x = 0; x < width; ++x) {
+            __m128 sum = _mm_setzero_ps();
+            int count = 0;
+            for (int row = y - radius; row <= y + radius; ++row) {
+                for (int column = x - radius; column <= x + radius; ++column) {
+                    if (!wrap && (row < 0 || row >= height || column < 0 || column >= width)) {
+                        continue;
+                    }
+                    int sourceRow = wrap ? wrap_index(row, height) : row;
+                    int sourceColumn = wrap ? wrap_index(column, width) : column;
+                    sum = _mm_add_ps(sum, _mm_loadu_ps(src + sourceRow * rowFloats + sourceColumn * 4));
+                    ++count;
+                }
+            }
+            size_t index = y * rowFloats + x * 4;
+            blend.store(src + index, dst + index, layerDeposits + index, sum, count);
+        }
+    }
+}
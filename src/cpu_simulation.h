@@ -0,0 +1,124 @@
+#pragma once
+#include "agent_arrays.h"
+#include "agent_kernel.h"
+#include "attractor.h"
+#include "obstacles.h"
+#include "settings.h"
+#include "spawn.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+// CPU port of shaders/agents.glsl and shaders/diffusion_shader.glsl. It needs
+// no window or GL context, so batch runs can go to machines without a GPU.
+class CpuSimulation {
+public:
+    // interactions is settings.numSpecies squared, laid out as in species.h.
+    // spawnImage is only read for SpawnPattern::Image. obstacles and
+    // attractor are empty without settings.obstacles and settings.attractor.
+    CpuSimulation(const Settings& settings, const std::vector<float>& interactions, const SpawnImage& spawnImage,
+                  ObstacleField obstacles, const AttractorImage& attractor);
+
+    // One frame: agent update and deposit, then diffusion and decay. Random
+    // numbers depend on the seed and the number of steps taken, not on time.
+    void step(float deltaTime);
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    const AgentArrays& get_agents() const { return agents; }
+    SimdLevel get_simd_level() const { return simdLevel; }
+    int get_species_count() const { return speciesCount; }
+
+    // Trail of one species at a pixel, rows bottom-up like the GL texture
+    float get_trail(int x, int y, int species) const {
+        return trailMap[species / 4 * layer_size() + (static_cast<size_t>(y) * width + x) * 4 + species % 4];
+    }
+
+    // Fraction of tiles diffused in the last step
+    float get_active_tile_fraction() const { return activeTileFraction; }
+
+    // Self-check for headless --check diffusion: blurs the current trail once
+    // with the kernel step() picks and once with a plain loop over every
+    // pixel's (2r+1)^2 neighbourhood, and returns the largest difference
+    // between the two. Leaves the simulation as it was.
+    float check_diffusion(float deltaTime);
+
+private:
+    size_t layer_size() const { return static_cast<size_t>(width) * height * 4; }
+
+    void deposit();
+    void update_active_tiles();
+    void update_trail_tiles();
+    void build_trail_pyramid();
+    void diffuse_rows(int begin, int end, float deltaTime);
+    template <int Radius>
+    void diffuse_rows_direct(int begin, int end, float deltaTime, int layer);
+    void diffuse_rows_running_sum(int begin, int end, float deltaTime, int layer);
+    void diffuse_rows_reference(int begin, int end, float deltaTime, int layer);
+
+    // Calls span(x0, x1) for each run of active tiles in the tile row
+    // holding row y, x1 exclusive
+    template <typename Span>
+    void for_each_active_span(int y, Span span) const;
+
+    int width, height;
+    bool wrap;  // BoundaryMode::Wrap, opposite edges meet
+    int radius;
+    int speciesCount;
+    int layers;  // RGBA layers holding speciesCount channels
+    uint32_t seed;
+    uint32_t stepIndex = 0;
+    ThreadPool pool;
+    AgentArrays agents;
+    AgentKernel updateAgents;
+    SimdLevel simdLevel;
+
+    // Transposed interaction matrix, see AgentKernelParams
+    std::vector<float> interactionsByTrail;
+
+    // ObstacleField::texels, empty without walls
+    std::vector<float> obstacles;
+
+    // The attractor image resampled to the grid, empty without one
+    std::vector<float> attractor;
+    float attractorWeight;
+
+    // Frame N and N+1, layer-major like the GL texture array: species s is
+    // channel s % 4 of layer s / 4. Diffusion and sensing read trailMap,
+    // diffusion writes diffusedTrailMap, then they swap.
+    std::vector<float> trailMap;
+    std::vector<float> diffusedTrailMap;
+
+    // Levels 1 to sensorLod of trailMap's mip pyramid, each layered like
+    // it, rebuilt after every diffusion for sensors that read further than
+    // a pixel. Empty at the default sensor offset.
+    float sensorOffset;
+    int sensorLod;
+    std::vector<std::vector<float>> trailPyramid;
+
+    // Deposit counts per pixel and species in the same layout, added into
+    // diffusedTrailMap and cleared by the diffusion. Fixed point like the
+    // shaders, DEPOSIT_ONE per deposit.
+    DepositMode depositMode;
+    std::vector<uint32_t> deposits;
+
+    // Every thread but the first deposits its share of the agents into its
+    // own counts and tile flags, summed into deposits and agentTiles over
+    // the tiles it touched and cleared again. No atomics, and the sums come
+    // out the same whatever the split.
+    std::vector<std::vector<uint32_t>> threadDeposits;
+    std::vector<std::vector<uint8_t>> threadTiles;
+
+    // Square tiles, row-major, like the GL sparse kernel. Diffusion only
+    // runs on tiles that have trail within a tile's reach, had agents
+    // deposit, or still hold trail in diffusedTrailMap from the frame
+    // before. The rest are all zero and stay so.
+    int tilesX, tilesY;
+    std::vector<uint8_t> agentTiles;          // Deposited in this step
+    std::vector<uint8_t> trailTiles;          // trailMap has trail
+    std::vector<uint8_t> previousTrailTiles;  // diffusedTrailMap has trail
+    std::vector<uint8_t> activeTiles;         // Diffused this step
+    std::vector<uint8_t> rowTrail;            // Per row and tile, reduced into trailTiles
+    float activeTileFraction = 1.0f;
+};
@@ -0,0 +1,214 @@
+#include "diffusion.h"
+#include "shader.h"
+#include "trail_format.h"
+
+namespace {
+
+const char* PROGRAM_NAMES[] = {"naive", "tiled", "separable", "running sum", "sparse"};
+const char* PROGRAM_FILES[] = {
+    "../../src/shaders/diffusion_shader.glsl",
+    "../../src/shaders/diffusion_tiled.glsl",
+    "../../src/shaders/diffusion_separable.glsl",
+    "../../src/shaders/diffusion_running_sum.glsl",
+    "../../src/shaders/diffusion_sparse.glsl",
+};
+
+// The tiled kernel's workgroup is its shared-memory tile, so it stays 16x16
+const WorkgroupSize TILE_GROUP_SIZE = {16, 16};
+
+const std::vector<WorkgroupSize> PIXEL_GROUP_CANDIDATES = {{8, 8}, {16, 8}, {16, 16}, {32, 8}, {64, 4}};
+const std::vector<WorkgroupSize> LINE_GROUP_CANDIDATES = {{32, 1}, {64, 1}, {128, 1}, {256, 1}};
+
+int groups(int size, int groupSize) {
+    return (size + groupSize - 1) / groupSize;
+}
+
+}
+
+Diffusion::Diffusion(int width, int height, TrailFormat trailFormat, int speciesCount, BoundaryMode boundary,
+                     WorkgroupTuner& tuner)
+    : width(width), height(height), layers(trail_layers(trailFormat, speciesCount)),
+      internalFormat(trail_internal_format(trailFormat)),
+      tilesX(groups(width, ACTIVITY_TILE_SIZE)), tilesY(groups(height, ACTIVITY_TILE_SIZE)) {
+    ShaderPermutation permutation = trail_permutation(trailFormat, speciesCount);
+    std::string defines = permutation.define("BOUNDARY_MODE", static_cast<int>(boundary)).defines();
+    for (int i = 0; i < PROGRAM_COUNT; ++i) {
+        timers[i] = new GpuTimer();
+    }
+
+    glGenTextures(1, &blurTemp);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, blurTemp);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, internalFormat, width, height, layers);
+
+    // Filled in before the sparse kernel first runs
+    glGenBuffers(1, &tileFlags);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileFlags);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, tilesX * tilesY * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, tileFlags);
+
+    // Three uints of glDispatchComputeIndirect arguments, then the tiles
+    glGenBuffers(1, &tileList);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileList);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (3 + tilesX * tilesY) * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+    tileListProgram = create_compute_program("../../src/shaders/diffusion_tile_list.glsl", defines);
+
+    // Frames N and N+1 to benchmark on, so tuning leaves the caller's
+    // trail alone. Deposits bound by the caller get cleared.
+    GLuint scratch[2];
+    glGenTextures(2, scratch);
+    for (GLuint texture : scratch) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, internalFormat, width, height, layers);
+        glClearTexImage(texture, 0, GL_RGBA, GL_FLOAT, nullptr);
+    }
+
+    // Layout and size change what is fastest, the radius hardly does
+    std::string variant = std::string(" ") + trail_format_name(trailFormat) + " " + std::to_string(speciesCount) +
+                          " " + std::to_string(width) + "x" + std::to_string(height);
+    if (boundary != BoundaryMode::Bounce) {
+        variant += std::string(" ") + boundary_mode_name(boundary);
+    }
+    for (int i = 0; i < PROGRAM_COUNT; ++i) {
+        Program program = static_cast<Program>(i);
+        if (program == TILED) {
+            groupSizes[i] = TILE_GROUP_SIZE;
+        } else if (program == SPARSE) {
+            // Same work per pixel as the naive kernel, and an empty tile
+            // list would time nothing
+            groupSizes[i] = groupSizes[NAIVE];
+        } else {
+            groupSizes[i] = tuner.tune(
+                std::string("diffusion ") + PROGRAM_NAMES[i] + variant,
+                program == RUNNING_SUM ? LINE_GROUP_CANDIDATES : PIXEL_GROUP_CANDIDATES,
+                [&](WorkgroupSize size) {
+                    return create_compute_program(PROGRAM_FILES[i], defines + workgroup_defines(size));
+                },
+                [&](unsigned int shader, WorkgroupSize size) {
+                    run(program, shader, size, scratch[0], scratch[1]);
+                });
+        }
+        programs[i] = create_compute_program(PROGRAM_FILES[i], defines + workgroup_defines(groupSizes[i]));
+    }
+
+    glDeleteTextures(2, scratch);
+}
+
+Diffusion::~Diffusion() {
+    for (int i = 0; i < PROGRAM_COUNT; ++i) {
+        glDeleteProgram(programs[i]);
+        delete timers[i];
+    }
+    glDeleteTextures(1, &blurTemp);
+    glDeleteProgram(tileListProgram);
+    glDeleteBuffers(1, &tileFlags);
+    glDeleteBuffers(1, &tileList);
+}
+
+DiffusionKernel Diffusion::resolve(DiffusionKernel kernel, int radius) {
+    if (kernel == DiffusionKernel::Tiled && radius != 1) {
+        return DiffusionKernel::Separable;
+    }
+    if (kernel == DiffusionKernel::Sparse && radius > ACTIVITY_TILE_SIZE) {
+        return DiffusionKernel::Separable;
+    }
+    return kernel;
+}
+
+void Diffusion::dispatch(DiffusionKernel kernel, int radius, GLuint trailMap, GLuint diffusedTrailMap) {
+    Program program = NAIVE;
+    switch (resolve(kernel, radius)) {
+        case DiffusionKernel::Naive: program = NAIVE; break;
+        case DiffusionKernel::Tiled: program = TILED; break;
+        case DiffusionKernel::Separable: program = radius <= SEPARABLE_MAX_RADIUS ? SEPARABLE : RUNNING_SUM; break;
+        case DiffusionKernel::Sparse: program = SPARSE; break;
+    }
+
+    // Other kernels don't maintain the trail bits, so on switching over
+    // every tile starts out active and the flags settle after two frames
+    if (program == SPARSE && !tilesTracked) {
+        GLuint allSet = ~0u;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileFlags);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &allSet);
+    }
+    tilesTracked = program == SPARSE;
+
+    timers[program]->begin();
+    run(program, programs[program], groupSizes[program], trailMap, diffusedTrailMap);
+    timers[program]->end();
+    lastProgram = program;
+    ++frame;
+}
+
+void Diffusion::run(Program program, unsigned int shader, WorkgroupSize groupSize, GLuint trailMap,
+                    GLuint diffusedTrailMap) {
+    if (program == SPARSE) {
+        // List the active tiles and count them into the dispatch arguments
+        GLuint arguments[3] = {0, 1, static_cast<GLuint>(layers)};
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileList);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(arguments), arguments);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, tileList);
+        glUseProgram(tileListProgram);
+        glUniform2i(0, tilesX, tilesY);  // tileCount
+        glUniform1ui(1, frame & 1);      // parity
+        glDispatchCompute(groups(tilesX * tilesY, 64), 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    }
+
+    // Per-pass uniforms sit at explicit locations, the rest is SimParams
+    glUseProgram(shader);
+    if (program == SPARSE) {
+        glUniform1ui(0, frame & 1);  // parity
+        glBindImageTexture(0, trailMap, 0, GL_TRUE, 0, GL_READ_ONLY, internalFormat);
+        glBindImageTexture(1, diffusedTrailMap, 0, GL_TRUE, 0, GL_WRITE_ONLY, internalFormat);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, tileList);
+        glDispatchComputeIndirect(0);
+        return;
+    }
+
+    if (program == NAIVE || program == TILED) {
+        glBindImageTexture(0, trailMap, 0, GL_TRUE, 0, GL_READ_ONLY, internalFormat);
+        glBindImageTexture(1, diffusedTrailMap, 0, GL_TRUE, 0, GL_WRITE_ONLY, internalFormat);
+        if (program == NAIVE) {
+            glDispatchCompute(groups(width, groupSize.x), groups(height, groupSize.y), layers);
+        } else {
+            glDispatchCompute(groups(width, TILE_GROUP_SIZE.x), groups(height, TILE_GROUP_SIZE.y), layers);
+        }
+        return;
+    }
+
+    for (int pass = 0; pass < 2; ++pass) {
+        // Horizontal: trailMap -> blurTemp. Vertical: blurTemp -> diffusedTrailMap,
+        // blending with the unblurred trailMap.
+        GLuint input = pass == 0 ? trailMap : blurTemp;
+        GLuint output = pass == 0 ? blurTemp : diffusedTrailMap;
+        glBindImageTexture(0, input, 0, GL_TRUE, 0, GL_READ_ONLY, internalFormat);
+        glBindImageTexture(1, output, 0, GL_TRUE, 0, GL_WRITE_ONLY, internalFormat);
+        glBindImageTexture(2, trailMap, 0, GL_TRUE, 0, GL_READ_ONLY, internalFormat);
+        glUniform1i(0, pass);  // vertical
+
+        if (program == SEPARABLE) {
+            glDispatchCompute(groups(width, groupSize.x), groups(height, groupSize.y), layers);
+        } else {
+            // One invocation per row, then per column, of each layer
+            int lines = pass == 0 ? height : width;
+            glDispatchCompute(groups(lines, groupSize.x), layers, 1);
+        }
+
+        if (pass == 0) {
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+    }
+}
+
+double Diffusion::last_ms() {
+    return timers[lastProgram]->last_ms();
+}
+
+void Diffusion::print_timings() {
+    for (int i = 0; i < PROGRAM_COUNT; ++i) {
+        double ms = timers[i]->take_average_ms();
+        if (ms >= 0.0) {
+            std::cout << "Diffusion (" << PROGRAM_NAMES[i] << "): " << ms << " ms" << std::endl;
+        }
+    }
+}
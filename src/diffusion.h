@@ -0,0 +1,85 @@
+#pragma once
+#include "config.h"
+#include "gpu_timer.h"
+#include "settings.h"
+#include "workgroup_tuner.h"
+
+// Largest radius the separable kernel blurs with direct taps. Above it the
+// running-sum shader takes over, whose cost doesn't depend on the radius.
+const int SEPARABLE_MAX_RADIUS = 4;
+
+// Side of the square tiles the sparse kernel tracks activity in, and so
+// its largest radius. Must match shaders/tiles.glsl.
+const int ACTIVITY_TILE_SIZE = 64;
+
+// GL diffusion pass: blurs and decays frame N (trailMap) into frame N+1
+// (diffusedTrailMap) with one of the DiffusionKernel implementations.
+class Diffusion {
+public:
+    // Trail textures passed to dispatch() must be texture arrays in
+    // trailFormat with trail_layers(trailFormat, speciesCount) layers.
+    // Every kernel is compiled for the boundary mode.
+    // Workgroup sizes come from tuner, which benchmarks on scratch
+    // textures if they aren't cached yet, with the SimParams bound by the
+    // caller. Binds the tile flags to shader
+    // storage binding 2 for good, since the agent pass marks them too.
+    Diffusion(int width, int height, TrailFormat trailFormat, int speciesCount, BoundaryMode boundary,
+              WorkgroupTuner& tuner);
+    ~Diffusion();
+
+    // Also adds the agents' deposit counts, bound to image unit 3 by the
+    // caller, and clears them. Leaves diffusedTrailMap and the counts
+    // written by image stores; the caller issues the barrier for whatever
+    // reads them next. The shaders take the time step, radius and decay
+    // from the SimParams the caller pushed (sim_params.h); radius here
+    // picks the kernel and has to match.
+    void dispatch(DiffusionKernel kernel, int radius, GLuint trailMap, GLuint diffusedTrailMap);
+
+    // Kernel dispatch() falls back to when the requested one can't do the
+    // radius (the tiled kernel only has a one pixel halo, the sparse one
+    // only looks one tile around)
+    static DiffusionKernel resolve(DiffusionKernel kernel, int radius);
+
+    // Average GPU time of every shader that ran since the last call
+    void print_timings();
+
+    // GPU time of the newest finished dispatch() with the kernel that ran
+    // last, or a negative value before one has finished
+    double last_ms();
+
+private:
+    // Separable is split into its two implementations here
+    enum Program {
+        NAIVE,
+        TILED,
+        SEPARABLE,
+        RUNNING_SUM,
+        SPARSE,
+        PROGRAM_COUNT
+    };
+
+    // Runs one kernel, both passes for the two-pass ones. shader is
+    // programs[program] except while tuning.
+    void run(Program program, unsigned int shader, WorkgroupSize groupSize, GLuint trailMap,
+             GLuint diffusedTrailMap);
+
+    int width, height;
+    int layers;
+    GLenum internalFormat;
+    unsigned int programs[PROGRAM_COUNT];
+    WorkgroupSize groupSizes[PROGRAM_COUNT];
+    GpuTimer* timers[PROGRAM_COUNT];
+    Program lastProgram = NAIVE;  // Dispatched last, for last_ms()
+
+    // Horizontal pass result of the two-pass kernels
+    GLuint blurTemp;
+
+    // Sparse kernel: per-tile activity flags and the indirect dispatch
+    // plus tile list built from them each frame, see shaders/tiles.glsl
+    unsigned int tileListProgram;
+    GLuint tileFlags;
+    GLuint tileList;
+    int tilesX, tilesY;
+    unsigned int frame = 0;     // Parity selects the flags' trail bit
+    bool tilesTracked = false;  // The last frame ran the sparse kernel
+};
@@ -0,0 +1,67 @@
+#include "gpu_timer.h"
+
+GpuTimer::GpuTimer() {
+    glGenQueries(QUERY_COUNT, queries);
+}
+
+GpuTimer::~GpuTimer() {
+    glDeleteQueries(QUERY_COUNT, queries);
+}
+
+void GpuTimer::begin() {
+    // Only waits if the query issued QUERY_COUNT passes ago is still busy,
+    // and then only for that one. It is the oldest, so results still come
+    // in issue order.
+    if (pending[next]) {
+        read(next);
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+}
+
+void GpuTimer::end() {
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[next] = true;
+    next = (next + 1) % QUERY_COUNT;
+}
+
+double GpuTimer::take_average_ms() {
+    collect();
+    if (samples == 0) {
+        return -1.0;
+    }
+    double average = totalMs / samples;
+    totalMs = 0.0;
+    samples = 0;
+    return average;
+}
+
+double GpuTimer::last_ms() {
+    collect();
+    return lastMs;
+}
+
+void GpuTimer::collect() {
+    // Oldest first, next is the query begin() reuses. Queries finish in the
+    // order they were issued, so the first one still running ends the scan.
+    for (int k = 0; k < QUERY_COUNT; ++k) {
+        int i = (next + k) % QUERY_COUNT;
+        if (!pending[i]) {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            return;
+        }
+        read(i);
+    }
+}
+
+void GpuTimer::read(int query) {
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(queries[query], GL_QUERY_RESULT, &elapsed);
+    lastMs = elapsed / 1.0e6;
+    totalMs += lastMs;
+    ++samples;
+    pending[query] = false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "config.h"
+
+// Measures GPU time spent between begin() and end() with GL_TIME_ELAPSED
+// queries. Results are read back a few frames later, so timing never
+// stalls the pipeline.
+class GpuTimer {
+public:
+    GpuTimer();
+    ~GpuTimer();
+
+    void begin();
+    void end();
+
+    // Average of the results collected since the last call, in
+    // milliseconds, or a negative value when nothing has finished yet
+    double take_average_ms();
+
+    // The newest result that has finished, in milliseconds, or a negative
+    // value before the first one. Leaves the average alone.
+    double last_ms();
+
+private:
+    // Reads every finished query, oldest first
+    void collect();
+    // Reads one query's result, waiting for it if the GPU isn't done
+    void read(int query);
+
+    // A few frames of queries, at up to MAX_SUBSTEPS (settings.h) a frame
+    static const int QUERY_COUNT = 64;
+    GLuint queries[QUERY_COUNT];
+    bool pending[QUERY_COUNT] = {};
+    int next = 0;
+
+    double totalMs = 0.0;
+    int samples = 0;
+    double lastMs = -1.0;
+};
@@ -0,0 +1,124 @@
+#include "cpu_simulation.h"
+#include "settings.h"
+#include "species.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+// Batch front end for the CPU backend: no window, no GL context
+namespace {
+
+bool write_ppm(const std::string& filename, const CpuSimulation& simulation) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    int width = simulation.get_width();
+    int height = simulation.get_height();
+    file << "P6\n" << width << " " << height << "\n255\n";
+
+    // Same colouring as quad.frag
+    int speciesCount = simulation.get_species_count();
+    std::vector<float> colors(speciesCount * 3);
+    for (int species = 0; species < speciesCount; ++species) {
+        species_color(species, speciesCount, &colors[species * 3]);
+    }
+
+    std::vector<unsigned char> row(static_cast<size_t>(width) * 3);
+    // PPM rows go top to bottom, the trail map is bottom-up like the GL texture
+    for (int y = height - 1; y >= 0; --y) {
+        for (int x = 0; x < width; ++x) {
+            float rgb[3] = {0.0f, 0.0f, 0.0f};
+            for (int species = 0; species < speciesCount; ++species) {
+                float trail = std::max(simulation.get_trail(x, y, species), 0.0f);
+                for (int c = 0; c < 3; ++c) {
+                    rgb[c] += trail * colors[species * 3 + c];
+                }
+            }
+            for (int c = 0; c < 3; ++c) {
+                row[x * 3 + c] = static_cast<unsigned char>(std::clamp(rgb[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+    return static_cast<bool>(file);
+}
+
+}
+
+int main(int argc, char** argv) {
+    Settings settings;
+    if (!parse_settings(argc, argv, settings)) {
+        return -1;
+    }
+
+    // The CPU kernel always weighs through a matrix. Own and others are the
+    // matrices the GL kernels for those rules hard-code; similarity has no
+    // matrix form.
+    if (settings.senseRule == SenseRule::Similarity) {
+        std::cerr << "--sense-rule similarity is only available windowed" << std::endl;
+        return -1;
+    }
+    std::vector<float> interactions = settings.senseRule == SenseRule::Own ? own_interactions(settings.numSpecies)
+                                                                           : default_interactions(settings.numSpecies);
+    if (settings.senseRule == SenseRule::Matrix && !settings.interactions.empty() &&
+        !load_interactions(settings.interactions, settings.numSpecies, interactions)) {
+        return -1;
+    }
+
+    SpawnImage spawnImage;
+    if (settings.spawn == SpawnPattern::Image) {
+        ThreadPool pool(settings.threads);
+        if (!load_spawn_image(settings.spawnImage, pool, spawnImage)) {
+            return -1;
+        }
+    }
+
+    ObstacleField obstacles;
+    if (!settings.obstacles.empty()) {
+        ThreadPool pool(settings.threads);
+        if (!load_obstacles(settings.obstacles, settings.width, settings.height, pool, obstacles)) {
+            return -1;
+        }
+    }
+
+    AttractorImage attractor;
+    if (!settings.attractor.empty() && !load_attractor(settings.attractor, attractor)) {
+        return -1;
+    }
+
+    CpuSimulation simulation(settings, interactions, spawnImage, std::move(obstacles), attractor);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < settings.steps; ++step) {
+        simulation.step(settings.deltaTime);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << settings.steps << " steps (" << simd_level_name(simulation.get_simd_level()) << "), "
+              << settings.numAgents << " agents, " << settings.width << "x" << settings.height << ": " << elapsed.count() << " ms";
+    if (settings.steps > 0) {
+        std::cout << " (" << elapsed.count() / settings.steps << " ms/step, "
+                  << simulation.get_active_tile_fraction() * 100.0f << "% of tiles active at the end)";
+    }
+    std::cout << std::endl;
+
+    if (!write_ppm(settings.output, simulation)) {
+        std::cerr << "Failed to write " << settings.output << std::endl;
+        return -1;
+    }
+
+    if (settings.checkDiffusion) {
+        float error = simulation.check_diffusion(settings.deltaTime);
+        std::cout << "Diffusion check: largest difference from a plain box blur " << error << std::endl;
+        if (error > 1e-4f) {
+            std::cerr << "Diffusion check failed" << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
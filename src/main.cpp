@@ -1,100 +1,86 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <glm/glm.hpp>
-
-const GLuint HEIGHT = 480;
-const GLuint WIDTH = (GLuint)(HEIGHT * 4.0f / 3.0f); // 16:9 aspect ratio
-const int NUM_AGENTS = 10000;
-
-struct Agent {
-    GLfloat x, y, angle;
-    GLint species;
+#include "agent.h"
+#include "attractor.h"
+#include "diffusion.h"
+#include "gpu_timer.h"
+#include "obstacles.h"
+#include "settings.h"
+#include "shader.h"
+#include "sim_params.h"
+#include "spawn.h"
+#include "species.h"
+#include "trail_format.h"
+#include "workgroup_tuner.h"
+
+const char* WORKGROUP_CACHE = "workgroup_sizes.txt";  // Tuned sizes, per driver
+const char* PROGRAM_CACHE = "program_cache";          // Shader binaries, see set_program_cache()
+const int SPAWN_GROUP_SIZE = 256;  // local_size_x of shaders/agents_init.glsl
+
+// One dimension of a dispatch only has to go up to 65535 groups, less than
+// 100M agents need. Larger counts go into rows of that many groups, which
+// agent_index() in shaders/agent.glsl flattens again.
+const int MAX_GROUPS_X = 65535;
+
+struct GroupCount {
+    GLuint x, y;
 };
 
-unsigned int simple_hash_random(int seed) {
-    // Use ^ a bunch to make it random
-    seed ^= (seed << 13);
-    seed ^= (seed >> 17);
-    seed ^= (seed << 5);
-    seed ^= (seed >> 7);
-    seed ^= (seed << 11);
-    seed ^= (seed >> 19);
-    return seed;
+GroupCount agent_groups(int count, int groupSize) {
+    int groups = (count + groupSize - 1) / groupSize;
+    if (groups <= MAX_GROUPS_X) {
+        return {static_cast<GLuint>(groups), 1};
+    }
+    return {MAX_GROUPS_X, static_cast<GLuint>((groups + MAX_GROUPS_X - 1) / MAX_GROUPS_X)};
 }
 
-// Shader loading and program creation
-unsigned int load_shader(const std::string& shader_file, GLenum shader_type) {
-    std::ifstream file(shader_file);
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string source = buffer.str();
-
-    const char* shader_source = source.c_str();
-    unsigned int shader = glCreateShader(shader_type);
-    glShaderSource(shader, 1, &shader_source, nullptr);
-    glCompileShader(shader);
-
-    int success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[1024];
-        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-        std::cerr << "Shader compilation failed: " << infoLog << std::endl;
+int main(int argc, char** argv) {
+    Settings settings;
+    if (!parse_settings(argc, argv, settings)) {
+        return -1;
     }
 
-    return shader;
-}
-
-unsigned int create_compute_program(const std::string& shader_file) {
-    unsigned int compute_shader = load_shader(shader_file, GL_COMPUTE_SHADER);
-    unsigned int program = glCreateProgram();
-    glAttachShader(program, compute_shader);
-    glLinkProgram(program);
+    // Only the matrix rule reads the interaction matrix, see SenseRule
+    std::vector<float> interactions = default_interactions(settings.numSpecies);
+    if (settings.senseRule == SenseRule::Matrix && !settings.interactions.empty() &&
+        !load_interactions(settings.interactions, settings.numSpecies, interactions)) {
+        return -1;
+    }
 
-    int success;
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(program, 512, nullptr, infoLog);
-        std::cerr << "Program linking failed: " << infoLog << std::endl;
+    SpawnImage spawnImage;
+    if (settings.spawn == SpawnPattern::Image) {
+        ThreadPool pool;
+        if (!load_spawn_image(settings.spawnImage, pool, spawnImage)) {
+            return -1;
+        }
     }
 
-    glDeleteShader(compute_shader);
-    return program;
-}
+    ObstacleField obstacles;
+    if (!settings.obstacles.empty()) {
+        ThreadPool pool;
+        if (!load_obstacles(settings.obstacles, settings.width, settings.height, pool, obstacles)) {
+            return -1;
+        }
+    }
 
-unsigned int create_shader_program(const std::string& vertex_file, const std::string& fragment_file) {
-    unsigned int vertex_shader = load_shader(vertex_file, GL_VERTEX_SHADER);
-    unsigned int fragment_shader = load_shader(fragment_file, GL_FRAGMENT_SHADER);
-    
-    unsigned int program = glCreateProgram();
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
-    glLinkProgram(program);
-    
-    int success;
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(program, 512, nullptr, infoLog);
-        std::cerr << "Program linking failed: " << infoLog << std::endl;
-    }
-    
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
-    return program;
-}
+    AttractorImage attractor;
+    if (!settings.attractor.empty() && !load_attractor(settings.attractor, attractor)) {
+        return -1;
+    }
 
-int main() {
     if (!glfwInit()) {
         std::cerr << "GLFW initialization failed!" << std::endl;
         return -1;
     }
 
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Random Noise Texture", nullptr, nullptr);
+    GLFWwindow* window = glfwCreateWindow(settings.windowWidth, settings.windowHeight, "Random Noise Texture",
+                                          nullptr, nullptr);
     if (!window) {
         std::cerr << "GLFW window creation failed!" << std::endl;
         glfwTerminate();
@@ -107,60 +93,331 @@ int main() {
         return -1;
     }
 
+    set_program_cache(PROGRAM_CACHE);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
-    // Create a texture to store noise
-    GLuint trailMap, diffusedTrailMap, displayTexture;
-    glGenTextures(1, &trailMap);
-    glBindTexture(GL_TEXTURE_2D, trailMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, WIDTH, HEIGHT, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    float currentTime = glfwGetTime();
-
-    int seed = simple_hash_random(static_cast<int>(currentTime)%10000); // Use time as seed
-    srand(static_cast<unsigned int>(seed * 1000)); // Seed with time + index
-
-    // Create agents data
-    Agent agents[NUM_AGENTS];
-    for (int i = 0; i < NUM_AGENTS; ++i) {
-        agents[i].x = static_cast<float>(rand()) / RAND_MAX * WIDTH; // Random x position
-        agents[i].y = static_cast<float>(rand()) / RAND_MAX * HEIGHT; // Random y position
-        // random angle using time
-        // Use time + agent index to generate a unique random angle
-        // Generate random angle using srand
-        agents[i].angle = static_cast<float>(rand()) / RAND_MAX * 2.0f * 3.14159f; // Random angle
-        agents[i].species = i % 3; // Random species (0, 1, or 2)
-
-        // std::cout << "Agent " << i << ": (" << agents[i].x << ", " << agents[i].y << "), angle: " << agents[i].angle << std::endl;
-        // static_cast<float>(rand()) / RAND_MAX * 2.0f * 3.14159f; // Random angle
+    // The simulation grid is independent of the window, but has to fit in
+    // a texture on this device
+    const int WIDTH = settings.width;
+    const int HEIGHT = settings.height;
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if (WIDTH > maxTextureSize || HEIGHT > maxTextureSize) {
+        std::cerr << "Grid " << WIDTH << "x" << HEIGHT << " exceeds the device's texture size limit of "
+                  << maxTextureSize << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
+    // Two trail textures used ping-pong style: each frame reads one and
+    // writes the other, then they swap roles. Each is an array with one
+    // channel per species, see shaders/trail.glsl.
+    GLenum trailFormat = trail_internal_format(settings.trailFormat);
+    int trailLayers = trail_layers(settings.trailFormat, settings.numSpecies);
+    ShaderPermutation trailPermutation = trail_permutation(settings.trailFormat, settings.numSpecies);
+    // Sensors further than a pixel read a mip level of frame N instead,
+    // so both textures get levels down to that one, see sensor_lod()
+    const int sensorLod = sensor_lod(settings.sensorOffset, WIDTH, HEIGHT);
+    GLuint trailMaps[2];
+    glGenTextures(2, trailMaps);
+    for (GLuint texture : trailMaps) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        for (int level = 0; level <= sensorLod; ++level) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, trailFormat, std::max(WIDTH >> level, 1),
+                         std::max(HEIGHT >> level, 1), trailLayers, 0, GL_RGBA, GL_FLOAT, nullptr);
+            glClearTexImage(texture, level, GL_RGBA, GL_FLOAT, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, sensorLod);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    int currentTrail = 0;
+
+    // Agents count their deposits here, one r32ui layer per species, and the
+    // diffusion pass adds them to the trail and clears them. It stays bound
+    // to image unit 3 for both passes. Raster deposits never count, so one
+    // texel per species stands in: the diffusion's loads outside it read
+    // zero and its stores are dropped.
+    const bool countDeposits = settings.deposit != DepositMode::Raster;
+    GLuint depositMap;
+    glGenTextures(1, &depositMap);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depositMap);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32UI, countDeposits ? WIDTH : 1, countDeposits ? HEIGHT : 1,
+                   settings.numSpecies);
+    glClearTexImage(depositMap, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindImageTexture(3, depositMap, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+
+    // Raster deposits skip the counts and draw every agent as a point into
+    // frame N+1 instead, through a framebuffer per trail texture with one
+    // colour attachment per layer. 16 species take at most 6 layers, within
+    // the 8 draw buffers GL guarantees.
+    unsigned int depositProgram = 0;
+    GLuint depositFramebuffers[2] = {0, 0};
+    GLuint depositVAO = 0;
+    if (settings.deposit == DepositMode::Raster) {
+        ShaderPermutation permutation = trailPermutation;
+        permutation.define("BOUNDARY_MODE", static_cast<int>(settings.boundary));
+        depositProgram = create_shader_program("../../src/shaders/deposit_points.vert",
+                                               "../../src/shaders/deposit_points.frag", permutation.defines());
+        std::vector<GLenum> drawBuffers;
+        for (int layer = 0; layer < trailLayers; ++layer) {
+            drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + layer);
+        }
+        glGenFramebuffers(2, depositFramebuffers);
+        for (int i = 0; i < 2; ++i) {
+            glBindFramebuffer(GL_FRAMEBUFFER, depositFramebuffers[i]);
+            for (int layer = 0; layer < trailLayers; ++layer) {
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + layer, trailMaps[i], 0, layer);
+            }
+            glDrawBuffers(trailLayers, drawBuffers.data());
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cerr << "Can't draw raster deposits into " << trail_format_name(settings.trailFormat)
+                          << " trail textures on this device" << std::endl;
+                glfwTerminate();
+                return -1;
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glGenVertexArrays(1, &depositVAO);  // Core profile draws need one, even without attributes
+    }
+
+    // The agent pass reads walls from texture unit 1, see obstacles.h.
+    // Agents only ever fetch texels, so there is no filtering.
+    GLuint obstacleMap = 0;
+    ShaderPermutation agentPermutation = trailPermutation;
+    if (!obstacles.texels.empty()) {
+        glGenTextures(1, &obstacleMap);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, obstacleMap);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, WIDTH, HEIGHT);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, GL_RGBA, GL_FLOAT, obstacles.texels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glActiveTexture(GL_TEXTURE0);
+        obstacles = ObstacleField();
+        agentPermutation.define("OBSTACLES");
     }
 
+    // Attractor image on texture unit 2 at its own resolution, with
+    // mipmaps so sensors on a smaller grid read an average instead of
+    // skipping pixels
+    GLuint attractorMap = 0;
+    float attractorLod = 0.0f;
+    if (!attractor.pixels.empty()) {
+        int levels = 1;
+        while ((std::max(attractor.width, attractor.height) >> levels) > 0) {
+            ++levels;
+        }
+        bool wide = attractor.bytesPerPixel == 2;
+        glGenTextures(1, &attractorMap);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, attractorMap);
+        glTexStorage2D(GL_TEXTURE_2D, levels, wide ? GL_R16 : GL_R8, attractor.width, attractor.height);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, attractor.width, attractor.height, GL_RED,
+                        wide ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, attractor.pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glActiveTexture(GL_TEXTURE0);
+        attractorLod = std::max(std::log2(std::max(static_cast<float>(attractor.width) / WIDTH,
+                                                   static_cast<float>(attractor.height) / HEIGHT)), 0.0f);
+        attractor = AttractorImage();
+        agentPermutation.define("ATTRACTOR");
+    }
+
+    // The agent pass reads frame N through texture unit 3 as well, for
+    // pyramid levels and bilinear sensing. Filtering stays within the
+    // sensor's level and follows the boundary mode across the edges. The
+    // display keeps sampling level 0 through the textures' own filter.
+    GLuint trailSampler;
+    GLint trailWrap = settings.boundary == BoundaryMode::Wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+    glGenSamplers(1, &trailSampler);
+    glSamplerParameteri(trailSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glSamplerParameteri(trailSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(trailSampler, GL_TEXTURE_WRAP_S, trailWrap);
+    glSamplerParameteri(trailSampler, GL_TEXTURE_WRAP_T, trailWrap);
+    glBindSampler(3, trailSampler);
+    if (sensorLod > 0) {
+        agentPermutation.define("TRAIL_PYRAMID");
+    }
+    agentPermutation.define("DEPOSIT_MODE", static_cast<int>(settings.deposit))
+        .define("SENSE_RULE", static_cast<int>(settings.senseRule))
+        .define("BOUNDARY_MODE", static_cast<int>(settings.boundary));
+
+    // Every pass reads its parameters from the SimParams block, pushed
+    // once per frame. Until the loop starts they hold a 1/60 s step.
+    SimParams params = sim_params(settings);
+    params.sensorLod = sensorLod;
+    params.attractorLod = attractorLod;
+    SimParamsRing* simParams = new SimParamsRing();  // Owns GL objects, deleted before the context
+    simParams->push(params);
+
+    // Large grids in the wider formats can run out of video memory
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        std::cerr << "Not enough GPU memory for a " << WIDTH << "x" << HEIGHT << " grid in "
+                  << trail_format_name(settings.trailFormat) << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    // Agents live only on the GPU: the buffer is sized here and filled by
+    // the spawn pass, so the count isn't limited by host memory or a serial
+    // loop. One SSBO has to hold them all.
+    const int NUM_AGENTS = settings.numAgents;
+    GLint64 maxStorageBlockSize = 0;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxStorageBlockSize);
+    const GLint64 maxAgents = maxStorageBlockSize / static_cast<GLint64>(sizeof(Agent));
+    if (NUM_AGENTS > maxAgents) {
+        std::cerr << NUM_AGENTS << " agents exceed the device's storage block limit of " << maxAgents << std::endl;
+        glfwTerminate();
+        return -1;
+    }
     GLuint agentBuffer;
     glGenBuffers(1, &agentBuffer);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, agentBuffer);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, NUM_AGENTS * sizeof(Agent), agents, GL_STATIC_DRAW);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(NUM_AGENTS) * sizeof(Agent), nullptr,
+                 GL_STATIC_DRAW);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, agentBuffer);
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        std::cerr << "Not enough GPU memory for " << NUM_AGENTS << " agents" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
 
-    // Create and compile compute shader program
-    unsigned int compute_program = create_compute_program("../../src/shaders/agents.glsl");
-    glUseProgram(compute_program);
-
-    unsigned int diffusion_program = create_compute_program("../../src/shaders/diffusion_shader.glsl");
-    glUseProgram(diffusion_program);
-
-
-
+    // Image spawns sample the alias table built on load, see spawn.h
+    GLuint spawnTableBuffer = 0;
+    if (settings.spawn == SpawnPattern::Image) {
+        glGenBuffers(1, &spawnTableBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, spawnTableBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, spawnImage.table.size() * sizeof(AliasEntry), spawnImage.table.data(),
+                     GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, spawnTableBuffer);
+    }
 
+    // Writes every agent's starting state in place
+    unsigned int spawnProgram = create_compute_program("../../src/shaders/agents_init.glsl", trailPermutation.defines());
+    auto spawn_agents = [&]() {
+        glUseProgram(spawnProgram);
+        glUniform1i(glGetUniformLocation(spawnProgram, "pattern"), static_cast<int>(settings.spawn));
+        if (settings.spawn == SpawnPattern::Image) {
+            glUniform2ui(glGetUniformLocation(spawnProgram, "spawnImageSize"), spawnImage.width, spawnImage.height);
+            glUniform2f(glGetUniformLocation(spawnProgram, "spawnScale"), static_cast<float>(WIDTH) / spawnImage.width,
+                        static_cast<float>(HEIGHT) / spawnImage.height);
+        }
+        GroupCount groups = agent_groups(NUM_AGENTS, SPAWN_GROUP_SIZE);
+        glDispatchCompute(groups.x, groups.y, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    };
+    spawn_agents();
+
+    // Interaction matrix for sensing, laid out like the trail layers. The
+    // other rules have their weights compiled in.
+    GLuint interactionBuffer = 0;
+    if (settings.senseRule == SenseRule::Matrix) {
+        std::vector<float> packedInteractions =
+            pack_interactions(settings.trailFormat, settings.numSpecies, interactions);
+        glGenBuffers(1, &interactionBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, interactionBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, packedInteractions.size() * sizeof(float), packedInteractions.data(),
+                     GL_STATIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, interactionBuffer);
+    }
 
-    // Bind the noise texture to texture unit 0
-    glBindImageTexture(0, trailMap, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    // One agent update with the SimParams last pushed, shared by the tuner
+    // and the render loop. Agents sense the trail bound to image unit 0.
+    auto dispatch_agents = [&](unsigned int program, WorkgroupSize groupSize) {
+        glUseProgram(program);
+        GroupCount groups = agent_groups(NUM_AGENTS, groupSize.x);  // Round up to fit workgroups
+        glDispatchCompute(groups.x, groups.y, 1);
+    };
 
+    // Pick workgroup sizes for this device, or load them from the cache
+    WorkgroupTuner tuner(WORKGROUP_CACHE);
+
+    // Owns GL objects, so it is deleted before the context goes away. It
+    // also binds the tile flags the agent pass marks. Its kernels are tuned
+    // at radius 1, so a large radius doesn't make the naive one crawl.
+    SimParams tuningParams = params;
+    tuningParams.diffusionRadius = 1;
+    simParams->push(tuningParams);
+    Diffusion* diffusion =
+        new Diffusion(WIDTH, HEIGHT, settings.trailFormat, settings.numSpecies, settings.boundary, tuner);
+    simParams->push(params);
+
+    const char* agentsShader = "../../src/shaders/agents.glsl";
+    glBindImageTexture(0, trailMaps[0], 0, GL_TRUE, 0, GL_READ_ONLY, trailFormat);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, trailMaps[0]);
+    glActiveTexture(GL_TEXTURE0);
+    // One agent program per sense mode, each tuned on its own, so S can
+    // compare them with everything else the same. The permutation names
+    // the variant for the tuner; the lod changes its cost but isn't a define.
+    unsigned int agentPrograms[SENSE_MODE_COUNT];
+    WorkgroupSize agentGroupSizes[SENSE_MODE_COUNT];
+    GpuTimer* agentTimers[SENSE_MODE_COUNT];
+    for (int mode = 0; mode < SENSE_MODE_COUNT; ++mode) {
+        ShaderPermutation permutation = agentPermutation;
+        std::string defines = permutation.define("SENSE_MODE", mode).defines();
+        agentGroupSizes[mode] = tuner.tune(
+            "agents " + std::to_string(NUM_AGENTS) + " " + permutation.key() +
+                (sensorLod > 0 ? " lod " + std::to_string(sensorLod) : ""),
+            {{32, 1}, {64, 1}, {128, 1}, {256, 1}, {512, 1}},
+            [&](WorkgroupSize size) { return create_compute_program(agentsShader, defines + workgroup_defines(size)); },
+            [&](unsigned int program, WorkgroupSize size) { dispatch_agents(program, size); });
+        agentPrograms[mode] = create_compute_program(agentsShader, defines + workgroup_defines(agentGroupSizes[mode]));
+        agentTimers[mode] = new GpuTimer();
+    }
+    GpuTimer* depositTimer = depositProgram ? new GpuTimer() : nullptr;
+
+    // Tuning ran the agents for real, so spawn them again and drop their
+    // deposits
+    spawn_agents();
+    glClearTexImage(depositMap, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+    // D switches diffusion kernels and S sense modes while running, for
+    // A/B comparisons
+    glfwSetWindowUserPointer(window, &settings);
+    glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int, int action, int) {
+        Settings* settings = static_cast<Settings*>(glfwGetWindowUserPointer(window));
+        if (key == GLFW_KEY_D && action == GLFW_PRESS) {
+            switch (settings->diffusion) {
+                case DiffusionKernel::Naive: settings->diffusion = DiffusionKernel::Tiled; break;
+                case DiffusionKernel::Tiled: settings->diffusion = DiffusionKernel::Separable; break;
+                case DiffusionKernel::Separable: settings->diffusion = DiffusionKernel::Sparse; break;
+                case DiffusionKernel::Sparse: settings->diffusion = DiffusionKernel::Naive; break;
+            }
+            DiffusionKernel used = Diffusion::resolve(settings->diffusion, settings->diffusionRadius);
+            std::cout << "Diffusion kernel: " << diffusion_kernel_name(settings->diffusion);
+            if (used != settings->diffusion) {
+                std::cout << " (radius " << settings->diffusionRadius << ", using "
+                          << diffusion_kernel_name(used) << ")";
+            }
+            std::cout << std::endl;
+        }
+        if (key == GLFW_KEY_S && action == GLFW_PRESS) {
+            settings->sense = settings->sense == SenseMode::Image ? SenseMode::Bilinear : SenseMode::Image;
+            std::cout << "Sense mode: " << sense_mode_name(settings->sense) << std::endl;
+        }
+    });
+
+    const int TIMING_INTERVAL = 120;  // Frames between timing reports
+    unsigned frameCount = 0;
+    unsigned stepCount = 0;  // The agents' random step
 
 
     // Create shader program for rendering the texture
-    unsigned int render_program = create_shader_program("../../src/shaders/quad.vert", "../../src/shaders/quad.frag");
+    unsigned int render_program = create_shader_program("../../src/shaders/quad.vert", "../../src/shaders/quad.frag",
+                                                        trailPermutation.defines());
     glUseProgram(render_program);
+    std::vector<float> speciesColors(settings.numSpecies * 3);
+    for (int species = 0; species < settings.numSpecies; ++species) {
+        species_color(species, settings.numSpecies, &speciesColors[species * 3]);
+    }
+    glUniform3fv(glGetUniformLocation(render_program, "speciesColors"), settings.numSpecies, speciesColors.data());
+    GLint scaleLocation = glGetUniformLocation(render_program, "scale");
 
 
     // Fullscreen quad
@@ -186,56 +443,154 @@ int main() {
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
-    // Render loop
-    float lastTime = glfwGetTime();
+    // Render loop. The simulation advances in fixed steps of
+    // settings.deltaTime, as many per frame as the time that passed calls
+    // for, so it runs at the same speed whatever the display rate and the
+    // result only depends on the number of steps. substepLimit caps them
+    // to what fits settings.frameBudget by the GPU timers; further behind
+    // than that the simulation slows down instead of the frame rate.
+    double lastTime = glfwGetTime();
+    double accumulator = 0.0;  // Real time not simulated yet
+    int substepLimit = 1;
+    unsigned substepsSinceReport = 0;
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
 
-        float currentTime = glfwGetTime();
-        float deltaTime = currentTime - lastTime;
+        double currentTime = glfwGetTime();
+        accumulator += currentTime - lastTime;
         lastTime = currentTime;
-
+        int substeps = std::min(static_cast<int>(accumulator / settings.deltaTime), substepLimit);
+        accumulator = std::min(accumulator - substeps * settings.deltaTime, static_cast<double>(settings.deltaTime));
+        substepsSinceReport += substeps;
+
+        for (int substep = 0; substep < substeps; ++substep) {
+            params.stepIndex = stepCount++;
+            simParams->push(params);
+
+            // Step N is only read, step N+1 only written
+            GLuint trailMap = trailMaps[currentTrail];
+            GLuint diffusedTrailMap = trailMaps[1 - currentTrail];
+
+            // Agents sense step N and count their deposits
+            glBindImageTexture(0, trailMap, 0, GL_TRUE, 0, GL_READ_ONLY, trailFormat);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, trailMap);
+            glActiveTexture(GL_TEXTURE0);
+            int senseMode = static_cast<int>(settings.sense);
+            agentTimers[senseMode]->begin();
+            dispatch_agents(agentPrograms[senseMode], agentGroupSizes[senseMode]);
+            agentTimers[senseMode]->end();
+
+            // The diffusion pass reads and clears the deposit counts and tile flags
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+            // Blur and decay step N into step N+1 and add the deposits
+            diffusion->dispatch(settings.diffusion, settings.diffusionRadius, trailMap, diffusedTrailMap);
+
+            // Raster deposits blend into step N+1 once diffusion has stored
+            // it. Framebuffer writes need no barrier for the reads after them.
+            if (depositProgram) {
+                glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+                depositTimer->begin();
+                glBindFramebuffer(GL_FRAMEBUFFER, depositFramebuffers[1 - currentTrail]);
+                glViewport(0, 0, WIDTH, HEIGHT);
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE);
+                glUseProgram(depositProgram);
+                glBindVertexArray(depositVAO);
+                glDrawArrays(GL_POINTS, 0, NUM_AGENTS);
+                glBindVertexArray(0);
+                glDisable(GL_BLEND);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                depositTimer->end();
+            }
+
+            // Long sensors read step N+1's pyramid next step
+            if (sensorLod > 0) {
+                glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, diffusedTrailMap);
+                glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            }
+
+            // Step N+1 is sampled for display or read as an image next
+            // step, and the cleared deposits and tile flags are added to again
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                            GL_SHADER_STORAGE_BARRIER_BIT);
+            currentTrail = 1 - currentTrail;
+        }
+
+        // Steps that fit the budget by the newest timings, which are a few
+        // frames old. Until every pass has one the limit stays put.
+        double agentMs = agentTimers[static_cast<int>(settings.sense)]->last_ms();
+        double diffusionMs = diffusion->last_ms();
+        double depositMs = depositTimer ? depositTimer->last_ms() : 0.0;
+        if (agentMs >= 0.0 && diffusionMs >= 0.0 && depositMs >= 0.0) {
+            double stepMs = std::max(agentMs + diffusionMs + depositMs, 1e-3);
+            substepLimit = static_cast<int>(std::min(settings.frameBudget / stepMs,
+                                                     static_cast<double>(settings.maxSubsteps)));
+            substepLimit = std::max(substepLimit, 1);
+        }
+
+        // Render the texture to the screen, scaled to fit the window with
+        // the grid's aspect ratio kept
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glViewport(0, 0, framebufferWidth, framebufferHeight);
         glClear(GL_COLOR_BUFFER_BIT);
-
-        
-        // Update agent positions using compute shader
-        glUseProgram(compute_program);
-        glUniform1f(glGetUniformLocation(compute_program, "deltaTime"), deltaTime);
-        glUniform1f(glGetUniformLocation(compute_program, "time"), currentTime);
-        // Pass in NUM_AGENTS uint
-        glUniform1ui(glGetUniformLocation(compute_program, "NUM_AGENTS"), NUM_AGENTS);
-        // Pass dimensions of the texture to the compute shader as separate uints   
-        glUniform1ui(glGetUniformLocation(compute_program, "SCREEN_WIDTH"), WIDTH);
-        glUniform1ui(glGetUniformLocation(compute_program, "SCREEN_HEIGHT"), HEIGHT);
-
-        glBindImageTexture(0, trailMap, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-        int workgroupSize = 16;  // Or 32 for larger workgroups
-        glDispatchCompute((NUM_AGENTS + workgroupSize - 1) / workgroupSize, 1, 1); // Round up to fit workgroups
-
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT); // Wait for the compute shader to finish
-
-        // Dispatch the diffusion shader (same size as the texture)
-        glUseProgram(diffusion_program);
-        glBindImageTexture(0, trailMap, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-        glUniform1f(glGetUniformLocation(diffusion_program, "deltaTime"), deltaTime);
-        glDispatchCompute(WIDTH / 16, HEIGHT / 16, 1);  // Dispatch in 16x16 workgroups
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);  // Wait for the diffusion to complete
-
-
-        // Render the texture to the screen
+        float gridAspect = static_cast<float>(WIDTH) / HEIGHT;
+        float windowAspect = static_cast<float>(framebufferWidth) / std::max(framebufferHeight, 1);
         glUseProgram(render_program);  // Use rendering program
+        glUniform2f(scaleLocation, std::min(gridAspect / windowAspect, 1.0f),
+                    std::min(windowAspect / gridAspect, 1.0f));
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, trailMap);  // Bind the updated texture
+        glBindTexture(GL_TEXTURE_2D_ARRAY, trailMaps[currentTrail]);  // Bind the newest step
         glBindVertexArray(quadVAO);
         glDrawArrays(GL_TRIANGLES, 0, 6);  // Draw the texture to the screen
         glBindVertexArray(0);
 
         glfwSwapBuffers(window);  // Swap the buffer to display the updated frame
+
+        if (++frameCount % TIMING_INTERVAL == 0) {
+            for (int mode = 0; mode < SENSE_MODE_COUNT; ++mode) {
+                double ms = agentTimers[mode]->take_average_ms();
+                if (ms >= 0.0) {
+                    std::cout << "Agents (" << sense_mode_name(static_cast<SenseMode>(mode)) << "): " << ms << " ms"
+                              << std::endl;
+                }
+            }
+            if (depositTimer) {
+                double ms = depositTimer->take_average_ms();
+                if (ms >= 0.0) {
+                    std::cout << "Deposits (raster): " << ms << " ms" << std::endl;
+                }
+            }
+            diffusion->print_timings();
+            std::cout << "Steps per frame: " << static_cast<double>(substepsSinceReport) / TIMING_INTERVAL
+                      << " (limit " << substepLimit << ")" << std::endl;
+            substepsSinceReport = 0;
+        }
     }
 
 
-    glDeleteTextures(1, &trailMap);
-    glDeleteProgram(compute_program);
+    delete diffusion;
+    delete simParams;
+    for (int mode = 0; mode < SENSE_MODE_COUNT; ++mode) {
+        delete agentTimers[mode];
+        glDeleteProgram(agentPrograms[mode]);
+    }
+    delete depositTimer;
+    glDeleteProgram(depositProgram);
+    glDeleteFramebuffers(2, depositFramebuffers);
+    glDeleteVertexArrays(1, &depositVAO);
+    glDeleteTextures(2, trailMaps);
+    glDeleteSamplers(1, &trailSampler);
+    glDeleteTextures(1, &depositMap);
+    glDeleteTextures(1, &obstacleMap);
+    glDeleteTextures(1, &attractorMap);
+    glDeleteBuffers(1, &interactionBuffer);
+    glDeleteBuffers(1, &agentBuffer);
+    glDeleteBuffers(1, &spawnTableBuffer);
+    glDeleteProgram(spawnProgram);
     glDeleteProgram(render_program);
     glDeleteVertexArrays(1, &quadVAO);
     glDeleteBuffers(1, &quadVBO);
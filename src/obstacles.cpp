@@ -0,0 +1,157 @@
+#include "obstacles.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+namespace {
+
+// Stands in for "no feature on this line". Large enough that it never wins
+// against a real one, small enough that the parabola intersections below
+// stay finite.
+const float FAR = 1e20f;
+
+// Squared distance from each of n samples to the nearest feature, where f
+// holds 0 at features and FAR elsewhere, or the squared distances of an
+// earlier pass. The result is the lower envelope of parabolas rooted at
+// every sample. vertices and bounds are scratch of n and n + 1.
+void distance_transform_1d(const float* f, int n, float* distances, int* vertices, float* bounds) {
+    int k = 0;
+    vertices[0] = 0;
+    bounds[0] = -FAR;
+    bounds[1] = FAR;
+    for (int q = 1; q < n; ++q) {
+        float s;
+        while (true) {
+            int v = vertices[k];
+            s = ((f[q] + static_cast<float>(q) * q) - (f[v] + static_cast<float>(v) * v)) / (2.0f * (q - v));
+            if (s > bounds[k] || k == 0) {
+                break;
+            }
+            --k;
+        }
+        ++k;
+        vertices[k] = q;
+        bounds[k] = s;
+        bounds[k + 1] = FAR;
+    }
+
+    k = 0;
+    for (int q = 0; q < n; ++q) {
+        while (bounds[k + 1] < q) {
+            ++k;
+        }
+        float offset = static_cast<float>(q - vertices[k]);
+        distances[q] = offset * offset + f[vertices[k]];
+    }
+}
+
+// Squared distance from every pixel to the nearest one where features is
+// set: rows first, then columns of the row result
+std::vector<float> squared_distances(const std::vector<uint8_t>& features, int width, int height, ThreadPool& pool) {
+    std::vector<float> rows(features.size());
+    pool.parallel_for(0, height, [&](int begin, int end) {
+        std::vector<float> f(width);
+        std::vector<int> vertices(width);
+        std::vector<float> bounds(width + 1);
+        for (int y = begin; y < end; ++y) {
+            size_t row = static_cast<size_t>(y) * width;
+            for (int x = 0; x < width; ++x) {
+                f[x] = features[row + x] ? 0.0f : FAR;
+            }
+            distance_transform_1d(f.data(), width, &rows[row], vertices.data(), bounds.data());
+        }
+    });
+
+    std::vector<float> result(features.size());
+    pool.parallel_for(0, width, [&](int begin, int end) {
+        std::vector<float> f(height), distances(height);
+        std::vector<int> vertices(height);
+        std::vector<float> bounds(height + 1);
+        for (int x = begin; x < end; ++x) {
+            for (int y = 0; y < height; ++y) {
+                f[y] = rows[static_cast<size_t>(y) * width + x];
+            }
+            distance_transform_1d(f.data(), height, distances.data(), vertices.data(), bounds.data());
+            for (int y = 0; y < height; ++y) {
+                result[static_cast<size_t>(y) * width + x] = distances[y];
+            }
+        }
+    });
+    return result;
+}
+
+}
+
+bool load_obstacles(const std::string& filename, int width, int height, ThreadPool& pool, ObstacleField& field) {
+    int imageWidth, imageHeight, channels;
+    unsigned char* data = stbi_load(filename.c_str(), &imageWidth, &imageHeight, &channels, 1);
+    if (!data) {
+        std::cerr << "Failed to load obstacle mask " << filename << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+
+    // Nearest image pixel for every grid pixel. stb_image starts at the top
+    // row.
+    const size_t pixels = static_cast<size_t>(width) * height;
+    std::vector<uint8_t> walls(pixels), open(pixels);
+    pool.parallel_for(0, height, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            int imageY = imageHeight - 1 - static_cast<int>(static_cast<int64_t>(y) * imageHeight / height);
+            const unsigned char* imageRow = data + static_cast<size_t>(imageY) * imageWidth;
+            for (int x = 0; x < width; ++x) {
+                bool wall = imageRow[static_cast<int64_t>(x) * imageWidth / width] < 128;
+                walls[static_cast<size_t>(y) * width + x] = wall;
+                open[static_cast<size_t>(y) * width + x] = !wall;
+            }
+        }
+    });
+    stbi_image_free(data);
+
+    if (std::none_of(open.begin(), open.end(), [](uint8_t value) { return value != 0; })) {
+        std::cerr << "Obstacle mask " << filename << " is all wall, nowhere to move" << std::endl;
+        return false;
+    }
+
+    // Open pixels measure to the nearest wall and wall pixels to the nearest
+    // open one. Both are between pixel centres, so half a pixel puts the
+    // zero on the edge between them.
+    std::vector<float> toWall = squared_distances(walls, width, height, pool);
+    std::vector<float> toOpen = squared_distances(open, width, height, pool);
+    std::vector<float> distances(pixels);
+    pool.parallel_for(0, height, [&](int begin, int end) {
+        for (size_t i = static_cast<size_t>(begin) * width; i < static_cast<size_t>(end) * width; ++i) {
+            float distance = walls[i] ? 0.5f - std::sqrt(toOpen[i]) : std::sqrt(toWall[i]) - 0.5f;
+            distances[i] = std::min(distance, MAX_WALL_DISTANCE);
+        }
+    });
+
+    // Central differences, one-sided at the grid edges. Flat stretches far
+    // from any wall get a zero normal, which turns nothing.
+    field.width = width;
+    field.height = height;
+    field.texels.resize(pixels * 4);
+    pool.parallel_for(0, height, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            int below = std::max(y - 1, 0), above = std::min(y + 1, height - 1);
+            for (int x = 0; x < width; ++x) {
+                int left = std::max(x - 1, 0), right = std::min(x + 1, width - 1);
+                size_t i = static_cast<size_t>(y) * width + x;
+                float dx = distances[i - x + right] - distances[i - x + left];
+                float dy = distances[static_cast<size_t>(above) * width + x] -
+                           distances[static_cast<size_t>(below) * width + x];
+                float length = std::sqrt(dx * dx + dy * dy);
+                float normalX = length > 0.0f ? dx / length : 0.0f;
+                float normalY = length > 0.0f ? dy / length : 0.0f;
+                float* texel = &field.texels[i * 4];
+                texel[0] = distances[i];
+                texel[1] = normalX;
+                texel[2] = normalY;
+                texel[3] = std::atan2(normalY, normalX);
+            }
+        }
+    });
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "thread_pool.h"
+
+#include <string>
+#include <vector>
+
+// Distances are capped at the largest half float, the GL texture's format
+const float MAX_WALL_DISTANCE = 65504.0f;
+
+// Walls from a mask image as a signed distance field over the simulation
+// grid, so agents handle any geometry with one lookup at their own pixel
+// instead of testing obstacles one by one. Four floats per pixel, rows
+// bottom-up like the grid:
+//   distance to the nearest wall edge in pixels, negative inside walls,
+//   x and y of its unit gradient, which points away from the wall,
+//   the gradient's angle, so reflecting an agent needs no atan2.
+// The GL side keeps the same texels as an RGBA16F texture.
+struct ObstacleField {
+    int width = 0;
+    int height = 0;
+    std::vector<float> texels;
+};
+
+// Reads any format stb_image does and stretches it over a width x height
+// grid, where pixels darker than mid grey are walls. The exact Euclidean
+// distance transform (Felzenszwalb and Huttenlocher) runs rows then columns,
+// each line one task on pool. Prints a message and returns false if the file
+// can't be read or is all wall.
+bool load_obstacles(const std::string& filename, int width, int height, ThreadPool& pool, ObstacleField& field);
@@ -0,0 +1,53 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel Random
+// Numbers: As Easy as 1, 2, 3"). The output is a pure function of a
+// counter and a key, so there is no state to seed, store or advance: any
+// agent's numbers for any step come out the same in whatever order and on
+// whatever thread they are drawn. shaders/random.glsl and the vector form
+// in agent_kernel_impl.h implement the same rounds and have to stay in
+// step with this one.
+namespace philox {
+
+constexpr uint32_t M0 = 0xD2511F53u;  // Round multipliers
+constexpr uint32_t M1 = 0xCD9E8D57u;
+constexpr uint32_t W0 = 0x9E3779B9u;  // Key schedule increments
+constexpr uint32_t W1 = 0xBB67AE85u;
+constexpr int ROUNDS = 10;
+
+// Third counter word, so draws for different purposes never share numbers
+enum Stream : uint32_t {
+    STREAM_STEER = 0,  // Agent update, one draw per agent and step
+    STREAM_SPAWN = 1   // Initial agent positions, step 0
+};
+
+using Bits = std::array<uint32_t, 4>;
+
+inline Bits philox4x32(Bits counter, uint32_t key0, uint32_t key1) {
+    for (int round = 0; round < ROUNDS; ++round) {
+        if (round > 0) {
+            key0 += W0;
+            key1 += W1;
+        }
+        uint64_t product0 = static_cast<uint64_t>(M0) * counter[0];
+        uint64_t product1 = static_cast<uint64_t>(M1) * counter[2];
+        counter = {static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key0, static_cast<uint32_t>(product1),
+                   static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key1, static_cast<uint32_t>(product0)};
+    }
+    return counter;
+}
+
+// Four random words for one agent in one step
+inline Bits random_bits(uint32_t seed, uint32_t id, uint32_t step, Stream stream) {
+    return philox4x32({id, step, stream, 0}, seed, 0);
+}
+
+// Top 24 bits as a float in [0, 1). Both the conversion and the scale are
+// exact, so GLSL gets the same float without relying on its division.
+inline float random_unit(uint32_t bits) {
+    return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+}
@@ -0,0 +1,342 @@
+#include "settings.h"
+#include "species.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+bool parse_int(const char* text, int& value) {
+    try {
+        size_t used = 0;
+        value = std::stoi(text, &used);
+        return text[used] == '\0';
+    } catch (...) {
+        return false;
+    }
+}
+
+bool parse_uint(const char* text, unsigned& value) {
+    int parsed;
+    if (!parse_int(text, parsed) || parsed < 0) {
+        return false;
+    }
+    value = static_cast<unsigned>(parsed);
+    return true;
+}
+
+bool parse_simd_level(const std::string& text, SimdLevel& value) {
+    for (SimdLevel level : {SimdLevel::Auto, SimdLevel::Scalar, SimdLevel::Avx2, SimdLevel::Avx512}) {
+        if (text == simd_level_name(level)) {
+            value = level;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_diffusion_kernel(const std::string& text, DiffusionKernel& value) {
+    for (DiffusionKernel kernel : {DiffusionKernel::Naive, DiffusionKernel::Tiled, DiffusionKernel::Separable,
+                                   DiffusionKernel::Sparse}) {
+        if (text == diffusion_kernel_name(kernel)) {
+            value = kernel;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_trail_format(const std::string& text, TrailFormat& value) {
+    for (TrailFormat format : {TrailFormat::Rgba32f, TrailFormat::Rgba16f, TrailFormat::R11g11b10f,
+                               TrailFormat::Rgb10a2}) {
+        if (text == trail_format_name(format)) {
+            value = format;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_sense_mode(const std::string& text, SenseMode& value) {
+    for (SenseMode mode : {SenseMode::Image, SenseMode::Bilinear}) {
+        if (text == sense_mode_name(mode)) {
+            value = mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_deposit_mode(const std::string& text, DepositMode& value) {
+    for (DepositMode mode : {DepositMode::Point, DepositMode::Bilinear, DepositMode::Raster}) {
+        if (text == deposit_mode_name(mode)) {
+            value = mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_sense_rule(const std::string& text, SenseRule& value) {
+    for (SenseRule rule : {SenseRule::Matrix, SenseRule::Own, SenseRule::Others, SenseRule::Similarity}) {
+        if (text == sense_rule_name(rule)) {
+            value = rule;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_boundary_mode(const std::string& text, BoundaryMode& value) {
+    for (BoundaryMode mode : {BoundaryMode::Bounce, BoundaryMode::Wrap}) {
+        if (text == boundary_mode_name(mode)) {
+            value = mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_spawn_pattern(const std::string& text, SpawnPattern& value) {
+    for (SpawnPattern pattern : {SpawnPattern::Uniform, SpawnPattern::Disc, SpawnPattern::Ring, SpawnPattern::Image}) {
+        if (text == spawn_pattern_name(pattern)) {
+            value = pattern;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_float(const char* text, float& value) {
+    try {
+        size_t used = 0;
+        value = std::stof(text, &used);
+        return text[used] == '\0';
+    } catch (...) {
+        return false;
+    }
+}
+
+}
+
+bool parse_settings(int argc, char** argv, Settings& settings) {
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            print_usage(argv[0]);
+            return false;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << flag << std::endl;
+            return false;
+        }
+        const char* value = argv[++i];
+
+        bool ok;
+        if (flag == "--width") {
+            ok = parse_int(value, settings.width) && settings.width > 0 && settings.width <= MAX_GRID_SIZE;
+        } else if (flag == "--height") {
+            ok = parse_int(value, settings.height) && settings.height > 0 && settings.height <= MAX_GRID_SIZE;
+        } else if (flag == "--window-width") {
+            ok = parse_int(value, settings.windowWidth) && settings.windowWidth > 0;
+        } else if (flag == "--window-height") {
+            ok = parse_int(value, settings.windowHeight) && settings.windowHeight > 0;
+        } else if (flag == "--agents") {
+            ok = parse_int(value, settings.numAgents) && settings.numAgents > 0;
+        } else if (flag == "--species") {
+            ok = parse_int(value, settings.numSpecies) && settings.numSpecies > 0 && settings.numSpecies <= MAX_SPECIES;
+        } else if (flag == "--interactions") {
+            settings.interactions = value;
+            ok = true;
+        } else if (flag == "--radius") {
+            ok = parse_int(value, settings.diffusionRadius) && settings.diffusionRadius >= 0;
+        } else if (flag == "--diffusion") {
+            ok = parse_diffusion_kernel(value, settings.diffusion);
+        } else if (flag == "--trail-format") {
+            ok = parse_trail_format(value, settings.trailFormat);
+        } else if (flag == "--sense") {
+            ok = parse_sense_mode(value, settings.sense);
+        } else if (flag == "--frame-budget") {
+            ok = parse_float(value, settings.frameBudget) && settings.frameBudget > 0.0f;
+        } else if (flag == "--max-substeps") {
+            ok = parse_int(value, settings.maxSubsteps) && settings.maxSubsteps > 0 &&
+                 settings.maxSubsteps <= MAX_SUBSTEPS;
+        } else if (flag == "--steps") {
+            ok = parse_int(value, settings.steps) && settings.steps >= 0;
+        } else if (flag == "--dt") {
+            ok = parse_float(value, settings.deltaTime) && settings.deltaTime > 0.0f;
+        } else if (flag == "--threads") {
+            ok = parse_uint(value, settings.threads);
+        } else if (flag == "--simd") {
+            ok = parse_simd_level(value, settings.simd);
+        } else if (flag == "--seed") {
+            ok = parse_uint(value, settings.seed);
+        } else if (flag == "--spawn") {
+            ok = parse_spawn_pattern(value, settings.spawn);
+        } else if (flag == "--spawn-image") {
+            settings.spawnImage = value;
+            settings.spawn = SpawnPattern::Image;
+            ok = true;
+        } else if (flag == "--obstacles") {
+            settings.obstacles = value;
+            ok = true;
+        } else if (flag == "--attractor") {
+            settings.attractor = value;
+            ok = true;
+        } else if (flag == "--attractor-weight") {
+            ok = parse_float(value, settings.attractorWeight);
+        } else if (flag == "--sensor-offset") {
+            ok = parse_float(value, settings.sensorOffset) && settings.sensorOffset > 0.0f;
+        } else if (flag == "--deposit") {
+            ok = parse_deposit_mode(value, settings.deposit);
+        } else if (flag == "--sense-rule") {
+            ok = parse_sense_rule(value, settings.senseRule);
+        } else if (flag == "--boundary") {
+            ok = parse_boundary_mode(value, settings.boundary);
+        } else if (flag == "--check") {
+            settings.checkDiffusion = std::string(value) == "diffusion";
+            ok = settings.checkDiffusion;
+        } else if (flag == "--output") {
+            settings.output = value;
+            ok = true;
+        } else {
+            std::cerr << "Unknown option: " << flag << std::endl;
+            print_usage(argv[0]);
+            return false;
+        }
+
+        if (!ok) {
+            std::cerr << "Invalid value for " << flag << ": " << value << std::endl;
+            return false;
+        }
+    }
+
+    // Wrapped blur taps may only reach one grid size past the edge, see
+    // grid_pixel() in shaders/boundary.glsl
+    if (settings.boundary == BoundaryMode::Wrap &&
+        settings.diffusionRadius >= std::min(settings.width, settings.height)) {
+        std::cerr << "--boundary wrap needs a --radius smaller than the grid" << std::endl;
+        return false;
+    }
+    if (settings.spawn == SpawnPattern::Image && settings.spawnImage.empty()) {
+        std::cerr << "--spawn image needs --spawn-image" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --width N         simulation grid width in pixels, up to 16384 (default 640)\n"
+              << "  --height N        simulation grid height in pixels, up to 16384 (default 480)\n"
+              << "  --window-width N  windowed: initial window width, the grid is scaled to fit (default 640)\n"
+              << "  --window-height N windowed: initial window height (default 480)\n"
+              << "  --agents N        number of agents (default 10000)\n"
+              << "  --species N       number of species, 1 to 16 (default 3)\n"
+              << "  --interactions F  file of species x species weights, one row per sensing species\n"
+              << "                    (default: ignore own trail, repelled by all others)\n"
+              << "  --radius N        diffusion blur radius in pixels (default 1)\n"
+              << "  --diffusion K     windowed: naive, tiled, separable or sparse kernel, D cycles (default naive)\n"
+              << "  --trail-format F  windowed: rgba32f, rgba16f, r11g11b10f or rgb10a2 (default rgba32f)\n"
+              << "  --sense M         windowed: image or bilinear trail reads at the sensors, S switches\n"
+              << "                    (default image)\n"
+              << "  --dt SECONDS      fixed time step; windowed runs steps to keep up with real time\n"
+              << "                    (default 1/60)\n"
+              << "  --frame-budget MS windowed: GPU time the steps of one frame may take, slows the\n"
+              << "                    simulation down rather than the frame rate (default 12)\n"
+              << "  --max-substeps N  windowed: most steps per frame, 1 to 16 (default 4)\n"
+              << "  --steps N         headless: steps to simulate (default 1000)\n"
+              << "  --threads N       headless: worker threads, 0 = all cores (default 0)\n"
+              << "  --simd LEVEL      headless: auto, scalar, avx2 or avx512 (default auto)\n"
+              << "  --seed N          seed for spawning and steering (default 1)\n"
+              << "  --spawn P         uniform, disc, ring or image (default uniform)\n"
+              << "  --spawn-image F   spawn density from an image's brightness, implies --spawn image\n"
+              << "  --obstacles F     walls where an image is darker than mid grey, stretched over the grid\n"
+              << "  --attractor F     image whose brightness draws every species, like a food source\n"
+              << "  --attractor-weight W  its weight against the trail, negative repels (default 1)\n"
+              << "  --sensor-offset N how far ahead agents sense, further sensors average a larger area\n"
+              << "                    of the trail (default 10)\n"
+              << "  --deposit M       point or bilinear, which splats each deposit over 4 pixels, or windowed:\n"
+              << "                    raster, point deposits blended as GL_POINTS (default point)\n"
+              << "  --sense-rule R    matrix, which weighs every trail by --interactions, own, others or\n"
+              << "                    windowed: similarity, drawn to trail like the one under the agent\n"
+              << "                    (default matrix)\n"
+              << "  --boundary B      bounce off the grid edges or wrap around them (default bounce)\n"
+              << "  --output FILE     headless: trail map written as PPM (default trail.ppm)\n"
+              << "  --check diffusion headless: after the steps, compare one more blur with a plain\n"
+              << "                    (2r+1)^2 box blur and fail if they differ\n";
+}
+
+const char* diffusion_kernel_name(DiffusionKernel kernel) {
+    switch (kernel) {
+        case DiffusionKernel::Naive: return "naive";
+        case DiffusionKernel::Tiled: return "tiled";
+        case DiffusionKernel::Separable: return "separable";
+        case DiffusionKernel::Sparse: return "sparse";
+    }
+    return "unknown";
+}
+
+const char* spawn_pattern_name(SpawnPattern pattern) {
+    switch (pattern) {
+        case SpawnPattern::Uniform: return "uniform";
+        case SpawnPattern::Disc: return "disc";
+        case SpawnPattern::Ring: return "ring";
+        case SpawnPattern::Image: return "image";
+    }
+    return "unknown";
+}
+
+const char* sense_mode_name(SenseMode mode) {
+    switch (mode) {
+        case SenseMode::Image: return "image";
+        case SenseMode::Bilinear: return "bilinear";
+    }
+    return "unknown";
+}
+
+const char* deposit_mode_name(DepositMode mode) {
+    switch (mode) {
+        case DepositMode::Point: return "point";
+        case DepositMode::Bilinear: return "bilinear";
+        case DepositMode::Raster: return "raster";
+    }
+    return "unknown";
+}
+
+const char* sense_rule_name(SenseRule rule) {
+    switch (rule) {
+        case SenseRule::Matrix: return "matrix";
+        case SenseRule::Own: return "own";
+        case SenseRule::Others: return "others";
+        case SenseRule::Similarity: return "similarity";
+    }
+    return "unknown";
+}
+
+const char* boundary_mode_name(BoundaryMode mode) {
+    switch (mode) {
+        case BoundaryMode::Bounce: return "bounce";
+        case BoundaryMode::Wrap: return "wrap";
+    }
+    return "unknown";
+}
+
+const char* trail_format_name(TrailFormat format) {
+    switch (format) {
+        case TrailFormat::Rgba32f: return "rgba32f";
+        case TrailFormat::Rgba16f: return "rgba16f";
+        case TrailFormat::R11g11b10f: return "r11g11b10f";
+        case TrailFormat::Rgb10a2: return "rgb10a2";
+    }
+    return "unknown";
+}
+
+int sensor_lod(float sensorOffset, int width, int height) {
+    int lod = std::max(static_cast<int>(std::lround(std::log2(sensorOffset / BASE_SENSOR_OFFSET))), 0);
+    int levels = 1;
+    while ((std::max(width, height) >> levels) > 0) {
+        ++levels;
+    }
+    return std::min(lod, levels - 1);
+}
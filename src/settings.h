@@ -0,0 +1,135 @@
+#pragma once
+#include "cpu_features.h"
+
+#include <string>
+
+// Compute kernels for the GL diffusion pass
+enum class DiffusionKernel {
+    Naive,     // diffusion_shader.glsl, (2r+1)^2 imageLoads per pixel
+    Tiled,     // diffusion_tiled.glsl, shared-memory tile, radius 1 only
+    Separable, // Horizontal then vertical pass, running sums for large radii
+    Sparse     // Naive blur over the 64x64 tiles that have trail or agents
+};
+
+// Storage for the GL trail textures, which hold one channel per species.
+// The smaller formats mostly save bandwidth; the ones without a usable
+// alpha channel fit three species per layer instead of four.
+enum class TrailFormat {
+    Rgba32f,     // 16 bytes per pixel
+    Rgba16f,     // 8 bytes
+    R11g11b10f,  // 4 bytes, no sign bit so decay stops at zero
+    Rgb10a2      // 4 bytes, unorm, saturates at 1.0
+};
+
+// How the GL agent pass reads the trail at its sensors. Both read the
+// level of the mip pyramid sensor_lod() picks.
+enum class SenseMode {
+    Image,     // imageLoad or texelFetch of the texel under the sensor
+    Bilinear   // texture() through a filtering sampler: sub-pixel and clamped in hardware
+};
+const int SENSE_MODE_COUNT = 2;
+
+// How a sensor turns the trail it reads into a weight, see sense() in
+// shaders/agents.glsl. Each is its own compiled agent kernel.
+enum class SenseRule {
+    Matrix,     // Every species' trail through the interaction matrix, see species.h
+    Own,        // Only the species' own trail attracts
+    Others,     // The other species' trails repel, like default_interactions()
+    Similarity  // Windowed only: trail that looks like the one under the agent attracts
+};
+
+// What agents and the trail do at the edge of the grid
+enum class BoundaryMode {
+    Bounce,  // Agents reflect off the edges, the blur averages the pixels inside
+    Wrap     // Opposite edges meet on a torus, for tiling and endless patterns
+};
+
+// Where an agent's deposit lands on the grid. Point and bilinear count in
+// fixed point, see DEPOSIT_ONE in shaders/deposits.glsl.
+enum class DepositMode {
+    Point,     // All of it on the pixel under the agent
+    Bilinear,  // Split over the four nearest pixels, so trail moves smoothly with position
+    Raster     // Windowed: like point, but drawn as GL_POINTS with additive blending after
+               // diffusion instead of atomics, see shaders/deposit_points.vert. Headless runs point.
+};
+
+// Where agents start, see spawn.h
+enum class SpawnPattern {
+    Uniform,  // Anywhere on the grid, random heading
+    Disc,     // Filled disc in the middle, random heading
+    Ring,     // Thin ring in the middle, facing its centre
+    Image     // Density follows the brightness of settings.spawnImage
+};
+
+// Largest simulation grid width or height
+const int MAX_GRID_SIZE = 16384;
+
+// Most simulation steps the windowed front end runs per presented frame
+const int MAX_SUBSTEPS = 16;
+
+// Sensors this far ahead of an agent read single pixels. Further ones read
+// a level of the trail's mip pyramid, see sensor_lod().
+const float BASE_SENSOR_OFFSET = 10.0f;
+
+// Run configuration shared by the windowed and headless front ends.
+struct Settings {
+    int width = 640;   // Simulation grid, independent of the window
+    int height = 480;
+    int numAgents = 10000;
+    int diffusionRadius = 1;
+    int numSpecies = 3;
+    std::string interactions;  // Interaction matrix file, empty = default_interactions()
+    unsigned seed = 1;         // Key for every random draw, see philox.h
+    SpawnPattern spawn = SpawnPattern::Uniform;
+    std::string spawnImage;    // Greyscale weights for SpawnPattern::Image
+    std::string obstacles;     // Mask image, dark pixels are walls, see obstacles.h
+    std::string attractor;     // Image every species is drawn to, see attractor.h
+    float attractorWeight = 1.0f;  // Its weight against the trail, negative repels
+    float sensorOffset = BASE_SENSOR_OFFSET;  // How far ahead agents sense, in pixels
+    DepositMode deposit = DepositMode::Point;
+    SenseRule senseRule = SenseRule::Matrix;
+    BoundaryMode boundary = BoundaryMode::Bounce;
+    float deltaTime = 1.0f / 60.0f;  // Fixed time step of every simulation step
+
+    // Windowed only
+    int windowWidth = 640;
+    int windowHeight = 480;
+    DiffusionKernel diffusion = DiffusionKernel::Naive;
+    TrailFormat trailFormat = TrailFormat::Rgba32f;
+    SenseMode sense = SenseMode::Image;
+    float frameBudget = 12.0f;  // GPU milliseconds the steps of one frame may take
+    int maxSubsteps = 4;        // Steps per frame when catching up, up to MAX_SUBSTEPS
+
+    // Headless only
+    int steps = 1000;
+    unsigned threads = 0;  // 0 = one per hardware thread
+    SimdLevel simd = SimdLevel::Auto;
+    std::string output = "trail.ppm";
+    bool checkDiffusion = false;  // Compare the blur with a plain box blur after the steps
+};
+
+// Parses --name value pairs into settings. Prints a message and returns
+// false on unknown flags or malformed values.
+bool parse_settings(int argc, char** argv, Settings& settings);
+
+void print_usage(const char* program);
+
+const char* diffusion_kernel_name(DiffusionKernel kernel);
+
+const char* trail_format_name(TrailFormat format);
+
+const char* spawn_pattern_name(SpawnPattern pattern);
+
+const char* sense_mode_name(SenseMode mode);
+
+const char* deposit_mode_name(DepositMode mode);
+
+const char* sense_rule_name(SenseRule rule);
+
+const char* boundary_mode_name(BoundaryMode mode);
+
+// Mip level of the trail that sensors at sensorOffset read, so the area a
+// reading averages grows with its reach: one pixel at BASE_SENSOR_OFFSET,
+// 2x2 at twice that, and so on. Rounded to a whole level and capped at the
+// grid's smallest one.
+int sensor_lod(float sensorOffset, int width, int height);
@@ -0,0 +1,258 @@
+#include "shader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <random>
+
+namespace {
+
+// Program binaries are stored after this and their GL binary format
+const uint32_t CACHE_MAGIC = 0x42504c53;  // "SLPB"
+
+std::string cacheDirectory;  // Empty while the cache is off
+std::string cacheDriver;     // GL vendor, renderer and version
+std::vector<GLint> cacheFormats;  // Binary formats the driver loads
+
+// GLSL has no #include of its own. Expands #include "name" lines with the
+// named file from the including file's directory, and resets #line around
+// it so error line numbers point into the right file.
+std::string read_source(const std::string& shader_file, int depth = 0) {
+    std::ifstream file(shader_file);
+    if (!file) {
+        std::cerr << "Failed to open shader " << shader_file << std::endl;
+        return "";
+    }
+
+    std::string directory = shader_file.substr(0, shader_file.find_last_of("/\\") + 1);
+    std::string source;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        size_t open = line.find('"');
+        size_t close = line.find('"', open + 1);
+        if (line.compare(0, 8, "#include") != 0 || close == std::string::npos || depth > 8) {
+            source += line + "\n";
+            continue;
+        }
+        std::string included = directory + line.substr(open + 1, close - open - 1);
+        source += "#line 1\n" + read_source(included, depth + 1);
+        source += "#line " + std::to_string(lineNumber + 1) + "\n";
+    }
+    return source;
+}
+
+// The source the compiler sees: includes expanded and defines inserted
+std::string expand_source(const std::string& shader_file, const std::string& defines) {
+    std::string source = read_source(shader_file);
+
+    // Defines have to follow #version. #line keeps error line numbers
+    // pointing into the file.
+    if (!defines.empty()) {
+        size_t versionEnd = source.find('\n', source.find("#version")) + 1;
+        source.insert(versionEnd, defines + "#line 2\n");
+    }
+    return source;
+}
+
+unsigned int compile_shader(const std::string& source, GLenum shader_type) {
+    const char* shader_source = source.c_str();
+    unsigned int shader = glCreateShader(shader_type);
+    glShaderSource(shader, 1, &shader_source, nullptr);
+    glCompileShader(shader);
+
+    int success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char infoLog[1024];
+        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+        std::cerr << "Shader compilation failed: " << infoLog << std::endl;
+    }
+
+    return shader;
+}
+
+struct Stage {
+    GLenum type;
+    std::string source;
+};
+
+// Cache file for a program built from stages on this driver, named after
+// a 64-bit FNV-1a hash of everything that goes into the binary
+std::string cache_path(const std::vector<Stage>& stages) {
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&](const std::string& text) {
+        for (unsigned char c : text) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        hash = (hash ^ 0xff) * 1099511628211ull;  // Separator, so "ab" + "c" differs from "a" + "bc"
+    };
+    add(cacheDriver);
+    for (const Stage& stage : stages) {
+        add(std::to_string(stage.type));
+        add(stage.source);
+    }
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+    return (std::filesystem::path(cacheDirectory) / name.str()).string();
+}
+
+// Program from a cached binary, or 0 if there is none or the driver
+// rejects it
+unsigned int load_cached_program(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    uint32_t header[2];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != CACHE_MAGIC ||
+        std::find(cacheFormats.begin(), cacheFormats.end(), static_cast<GLint>(header[1])) == cacheFormats.end()) {
+        return 0;
+    }
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty()) {
+        return 0;
+    }
+
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, header[1], binary.data(), static_cast<GLsizei>(binary.size()));
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void save_cached_program(const std::string& path, unsigned int program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+    // Written aside and renamed, so parallel jobs never load half a file
+    std::string partial = path + "." + std::to_string(std::random_device()()) + ".tmp";
+    {
+        std::ofstream file(partial, std::ios::binary);
+        uint32_t header[2] = {CACHE_MAGIC, format};
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(binary.data(), static_cast<std::streamsize>(binary.size()));
+        if (!file) {
+            std::cerr << "Failed to write program cache " << partial << std::endl;
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(partial, path, error);
+    if (error) {
+        std::filesystem::remove(partial, error);
+    }
+}
+
+// Links a program from stages, or loads it from the cache when that is on
+unsigned int create_program(const std::vector<Stage>& stages) {
+    std::string path;
+    if (!cacheDirectory.empty()) {
+        path = cache_path(stages);
+        if (unsigned int program = load_cached_program(path)) {
+            return program;
+        }
+    }
+
+    unsigned int program = glCreateProgram();
+    std::vector<unsigned int> shaders;
+    for (const Stage& stage : stages) {
+        shaders.push_back(compile_shader(stage.source, stage.type));
+        glAttachShader(program, shaders.back());
+    }
+    if (!path.empty()) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(program);
+
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        std::cerr << "Program linking failed: " << infoLog << std::endl;
+    } else if (!path.empty()) {
+        save_cached_program(path, program);
+    }
+
+    for (unsigned int shader : shaders) {
+        glDeleteShader(shader);
+    }
+    return program;
+}
+
+}
+
+unsigned int load_shader(const std::string& shader_file, GLenum shader_type, const std::string& defines) {
+    return compile_shader(expand_source(shader_file, defines), shader_type);
+}
+
+unsigned int create_compute_program(const std::string& shader_file, const std::string& defines) {
+    return create_program({{GL_COMPUTE_SHADER, expand_source(shader_file, defines)}});
+}
+
+unsigned int create_shader_program(const std::string& vertex_file, const std::string& fragment_file,
+                                   const std::string& defines) {
+    return create_program({{GL_VERTEX_SHADER, expand_source(vertex_file, defines)},
+                           {GL_FRAGMENT_SHADER, expand_source(fragment_file, defines)}});
+}
+
+void set_program_cache(const std::string& directory) {
+    cacheDirectory.clear();
+    if (directory.empty()) {
+        return;
+    }
+
+    // Drivers may support no binary formats at all
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (formats == 0 || error) {
+        std::cerr << "Program cache " << directory << " unavailable, compiling shaders from source" << std::endl;
+        return;
+    }
+
+    auto gl_string = [](GLenum name) {
+        const GLubyte* value = glGetString(name);
+        return std::string(value ? reinterpret_cast<const char*>(value) : "");
+    };
+    cacheFormats.resize(formats);
+    glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, cacheFormats.data());
+    cacheDriver = gl_string(GL_VENDOR) + " / " + gl_string(GL_RENDERER) + " / " + gl_string(GL_VERSION);
+    cacheDirectory = directory;
+}
+
+ShaderPermutation& ShaderPermutation::define(const std::string& name, const std::string& value) {
+    values[name] = value;
+    return *this;
+}
+
+ShaderPermutation& ShaderPermutation::define(const std::string& name, int value) {
+    return define(name, std::to_string(value));
+}
+
+std::string ShaderPermutation::defines() const {
+    std::string lines;
+    for (const auto& [name, value] : values) {
+        lines += "#define " + name + (value.empty() ? "" : " " + value) + "\n";
+    }
+    return lines;
+}
+
+std::string ShaderPermutation::key() const {
+    std::string key;
+    for (const auto& [name, value] : values) {
+        key += (key.empty() ? "" : " ") + name + (value.empty() ? "" : "=" + value);
+    }
+    return key;
+}
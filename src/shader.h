@@ -0,0 +1,53 @@
+#pragma once
+#include "config.h"
+
+#include <map>
+
+// Shader loading and program creation. Compile and link errors are printed
+// to stderr.
+//
+// defines is inserted right after the #version line, e.g.
+// "#define TRAIL_FORMAT rgba16f\n", to specialise one source file. Lines
+// of the form #include "file.glsl" are replaced by that file, looked up next
+// to the including one.
+//
+// A ShaderPermutation collects those defines for one configuration of a
+// kernel, so each configuration compiles to its own program without runtime
+// branches on it. Programs are cached per permutation by
+// set_program_cache() like any other source.
+unsigned int load_shader(const std::string& shader_file, GLenum shader_type, const std::string& defines = "");
+
+unsigned int create_compute_program(const std::string& shader_file, const std::string& defines = "");
+
+unsigned int create_shader_program(const std::string& vertex_file, const std::string& fragment_file,
+                                   const std::string& defines = "");
+
+// Keeps linked programs in directory as driver binaries from now on, so
+// the next launch loads them instead of compiling. Entries are keyed by a
+// hash of the expanded sources with their defines and the GL vendor,
+// renderer and version, so editing a shader or updating the driver misses
+// the cache. A binary the driver rejects anyway is compiled from source
+// and replaced. Empty turns the cache off, which is the default. Needs a
+// current context.
+void set_program_cache(const std::string& directory);
+
+// The compile-time switches of one shader variant, as named values.
+// Defines come out sorted by name, so the same configuration always
+// expands to the same source and hits the same program cache entry.
+class ShaderPermutation {
+public:
+    // #define name value, replacing an earlier value. An empty value defines
+    // a flag for #ifdef.
+    ShaderPermutation& define(const std::string& name, const std::string& value = "");
+    ShaderPermutation& define(const std::string& name, int value);
+
+    // "#define NAME value\n" lines for load_shader()
+    std::string defines() const;
+
+    // One line naming the variant, e.g. for workgroup_tuner.h keys:
+    // "NAME=value FLAG ..."
+    std::string key() const;
+
+private:
+    std::map<std::string, std::string> values;
+};
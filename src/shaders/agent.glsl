@@ -0,0 +1,25 @@
+// Needs sim_params.glsl first for NUM_AGENTS
+
+// Struct to represent each agent, laid out like agent.h
+struct Agent {
+    float x;     // Agent's position (x-coordinate)
+    float y;     // Agent's position (y-coordinate)
+    float angle; // Agent's direction in radians
+    int species; // Agent's species identifier
+};
+
+// Buffer to store the agents
+layout(binding = 1) buffer AgentBuffer {
+    Agent agents[]; // Array of agents
+};
+
+// Agent passes run 1D groups, in rows of gl_NumWorkGroups.x groups once
+// there are more than one dimension's 65535 (see agent_groups in main.cpp).
+// Threads past NUM_AGENTS have to return. Include this after the
+// local_size layout, gl_WorkGroupSize isn't declared before it. Vertex
+// shaders, which index agents by gl_VertexID, define AGENT_VERTICES first.
+#ifndef AGENT_VERTICES
+uint agent_index() {
+    return gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x + gl_GlobalInvocationID.x;
+}
+#endif
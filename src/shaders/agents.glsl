@@ -1,100 +1,136 @@
 #version 450 core
 
-layout (local_size_x = 16, local_size_y = 16) in;  // One thread per agent
-
-// Struct to represent each agent
-struct Agent {
-    float x;     // Agent's position (x-coordinate)
-    float y;     // Agent's position (y-coordinate)
-    float angle; // Agent's direction in radians
-    int species; // Agent's species identifier
-};
-
-// Buffer to store the agents
-layout(binding = 1) buffer AgentBuffer {
-    Agent agents[]; // Array of agents
-};
+#include "sim_params.glsl"
+#include "trail.glsl"
+#include "deposits.glsl"
+#include "tiles.glsl"
+#include "random.glsl"
+#include "boundary.glsl"
+
+// One thread per agent in 1D groups, see agent_index(). The host picks the
+// group size, see workgroup_tuner.h.
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout (local_size_x = LOCAL_SIZE_X) in;
+
+#include "agent.glsl"
 
 // Uniform variables
-layout(binding = 0, rgba32f) uniform image2D trailMap;  // Trail texture
-uniform float deltaTime;  // Time passed since last frame
-uniform float time;       // Current time in seconds
-
-// Constants for simulation
-uniform uint NUM_AGENTS; // Number of agents to process
-const float RANDOM_TURN = 0.2;  // Random turn factor
-const float BASE_SPEED = 100.0;  // Base speed of the agents
-uniform uint SCREEN_WIDTH;  // Screen width
-uniform uint SCREEN_HEIGHT; // Screen height
-
-// Simple hash function to generate pseudo-random numbers
-uint hash(uint state) {
-    state ^= 2747636419u;
-    state *= 2654435769u;
-    state ^= state >> 16;
-    state *= 2654435769u;
-    state ^= state >> 16;
-    state *= 2654435769u;
-    return state;
-}
-
-// Scale the hash value to the range [0, 1]
-float scaleToRange01(uint state) {
-    return float(state) / 4294967295.0;
+// Agents sense frame N. Deposits are counted per species, one layer each,
+// and the diffusion pass adds them into frame N+1. Atomic adds don't lose
+// collisions and sum the same in any order, so dense trails get brighter
+// instead of saturating.
+layout(binding = 0, TRAIL_FORMAT) readonly uniform image2DArray trailMap;
+
+// settings.h's SenseMode: image reads the texel under the sensor, bilinear
+// filters between the four nearest through the sampler
+#define SENSE_IMAGE 0
+#define SENSE_BILINEAR 1
+#ifndef SENSE_MODE
+#define SENSE_MODE SENSE_IMAGE
+#endif
+
+// settings.h's SenseRule, how sense() weighs what it reads
+#define SENSE_MATRIX 0
+#define SENSE_OWN 1
+#define SENSE_OTHERS 2
+#define SENSE_SIMILARITY 3
+#ifndef SENSE_RULE
+#define SENSE_RULE SENSE_MATRIX
+#endif
+
+#if SENSE_RULE == SENSE_MATRIX
+// How strongly each species is drawn to each trail, positive attracts and
+// negative repels. Row s holds species s's weights laid out like the trail
+// layers, so a layer's weights are one dot product away.
+layout(std140, binding = 0) uniform Interactions {
+    vec4 interactions[SPECIES_COUNT * TRAIL_LAYERS];
+};
+#endif
+
+// Frame N again through the texture path. Level sensorLod of its mip
+// pyramid averages the area a sensor covers in one fetch, see sensor_lod()
+// in settings.h. Without TRAIL_PYRAMID there is only level 0.
+layout(binding = 3) uniform sampler2DArray trailSampler;
+
+#ifdef OBSTACLES
+// ObstacleField from obstacles.h at grid size: signed distance to the
+// nearest wall edge, the unit normal pointing away from it and the normal's
+// angle. One fetch per agent covers any wall geometry.
+layout(binding = 1) uniform sampler2D obstacleField;
+#endif
+
+#ifdef ATTRACTOR
+// Grey image from attractor.h that every species senses on top of the
+// trail. It is read through the texture cache at the mip level where one
+// texel covers about one grid pixel, so it costs one filtered fetch per
+// sensor.
+layout(binding = 2) uniform sampler2D attractor;
+#endif
+
+#if SENSE_RULE == SENSE_SIMILARITY
+// Frame N under the agent, read the way its sensors read, to compare them
+// against
+vec4 trailHere[TRAIL_LAYERS];
+#endif
+
+// One layer of frame N at pos, through the path SENSE_MODE and
+// TRAIL_PYRAMID pick
+vec4 read_trail(vec2 pos, int layer) {
+#if SENSE_MODE == SENSE_BILINEAR
+    // The host sets the sampler to clamp to the edge or repeat, the same
+    // as position_pixel() for the boundary mode
+    return textureLod(trailSampler, vec3(pos / vec2(SCREEN_WIDTH, SCREEN_HEIGHT), layer), float(sensorLod));
+#else
+    ivec2 coord = position_pixel(pos, ivec2(SCREEN_WIDTH, SCREEN_HEIGHT));
+#ifdef TRAIL_PYRAMID
+    ivec2 levelCoord = min(coord >> sensorLod, textureSize(trailSampler, sensorLod).xy - 1);
+    return texelFetch(trailSampler, ivec3(levelCoord, layer), sensorLod);
+#else
+    return imageLoad(trailMap, ivec3(coord, layer));
+#endif
+#endif
 }
 
-// Function to sense the trail strength in a given direction, only sensing its own color
+// Function to sense the trail strength in a given direction, weighted the
+// way SENSE_RULE says
 float sense(Agent agent, float sensorAngleOffset) {
     // Determine the sensor's direction based on its angle and offset
     float sensorAngle = agent.angle + sensorAngleOffset;
     vec2 sensorDir = vec2(cos(sensorAngle), sin(sensorAngle));
     
-    // Determine the position of the sensor (just slightly offset from the agent)
-    vec2 sensorPos = vec2(agent.x, agent.y) + sensorDir * 10.0; // Using a fixed offset of 10 units for sensing
-    ivec2 sensorCoord = ivec2(floor(sensorPos.x), floor(sensorPos.y));
-
-    // Clamp the sensor coordinates to the screen bounds
-    sensorCoord.x = int(clamp(sensorCoord.x, 0, SCREEN_WIDTH - 1));
-    sensorCoord.y = int(clamp(sensorCoord.y, 0, SCREEN_HEIGHT - 1));
-
-    // Sample the trail map at the sensor position to get the trail color
-    vec4 trailColor = imageLoad(trailMap, sensorCoord);
-
-    // ATTRACTION TO SIMILAR COLOR
-    // vec4 agentColor = vec4(0.0, 0.0, 0.0, 0.0); // Default color (black)
-    // agentColor = imageLoad(trailMap, ivec2(agent.x, agent.y)); // Load the agent's color
-
-    // Calculate the weight using abs difference between each rgb channel
-    // float weight = 0.0;
-    // weight += abs(trailColor.r - agentColor.r); // Red channel difference
-    // weight += abs(trailColor.g - agentColor.g); // Green channel difference
-    // weight += abs(trailColor.b - agentColor.b); // Blue channel difference
-
-    // return 1.0 - (weight / 3.0); // Normalize to [0, 1] range
-
-    // // ATTRACTION TO SPECIES 
-    // if (agent.species == 0) {
-    //     return trailColor.r; // Red channel for species 0
-    // } else if (agent.species == 1) {
-    //     return trailColor.g; // Green channel for species 1
-    // } else if (agent.species == 2) {
-    //     return trailColor.b; // Blue channel for species 2
-    // }
-    // return 0.0; // Default case (should not happen)
-
-    // Repulsion from different species
+    // Determine the position of the sensor, sensorOffset ahead of the agent
+    vec2 sensorPos = vec2(agent.x, agent.y) + sensorDir * sensorOffset;
+
     float weight = 0.0;
-    if (agent.species == 0) {
-        weight -= trailColor.g;
-        weight -= trailColor.b; // Repel from green and blue channels for species 0
-    } else if (agent.species == 1) {
-        weight -= trailColor.r;
-        weight -= trailColor.b; // Repel from red and blue channels for species 1
-    } else if (agent.species == 2) {
-        weight -= trailColor.r;
-        weight -= trailColor.g; // Repel from red and green channels for species 2
+#if SENSE_RULE == SENSE_OWN
+    // A single load of the layer holding the species
+    weight = read_trail(sensorPos, agent.species / TRAIL_CHANNELS)[agent.species % TRAIL_CHANNELS];
+#else
+    // Every species goes through the same loads and dot products, so agents
+    // of different species in one subgroup don't diverge. Unused channels
+    // have zero weight.
+    for (int layer = 0; layer < TRAIL_LAYERS; ++layer) {
+        vec4 trailColor = read_trail(sensorPos, layer);
+#if SENSE_RULE == SENSE_OTHERS
+        weight += dot(trailColor, species_channel(agent.species, layer) - species_mask(layer));
+#elif SENSE_RULE == SENSE_SIMILARITY
+        weight -= dot(abs(trailColor - trailHere[layer]), species_mask(layer));
+#else
+        weight += dot(trailColor, interactions[agent.species * TRAIL_LAYERS + layer]);
+#endif
     }
-    // Normalize the weight to [0, 1] range
+#if SENSE_RULE == SENSE_SIMILARITY
+    // One minus the mean difference, 1.0 for a perfect match
+    weight = 1.0 + weight / float(SPECIES_COUNT);
+#endif
+#endif
+#ifdef ATTRACTOR
+    ivec2 sensorCoord = position_pixel(sensorPos, ivec2(SCREEN_WIDTH, SCREEN_HEIGHT));
+    vec2 attractorCoord = (vec2(sensorCoord) + 0.5) / vec2(SCREEN_WIDTH, SCREEN_HEIGHT);
+    weight += attractorWeight * textureLod(attractor, attractorCoord, attractorLod).r;
+#endif
     return weight;
 }
 
@@ -110,9 +146,46 @@ void bounceOffWalls(inout Agent agent) {
     }
 }
 
+#ifdef OBSTACLES
+// Mirrors the agent back across a wall it moved into, or turns it away
+// from one it is heading into within sensor reach. wall is the field at its
+// pixel before it moved speed along direction; the distance after the move
+// is exact for straight walls.
+void bounceOffObstacles(inout Agent agent, vec4 wall, vec2 direction, float speed, float turn) {
+    float facing = dot(direction, wall.yz);
+    float distance = wall.x + speed * facing;
+    if (distance < 0.0) {
+        agent.x += -2.0 * distance * wall.y;
+        agent.y += -2.0 * distance * wall.z;
+        agent.angle = 2.0 * wall.w + 3.1415 - agent.angle;
+    } else if (distance < sensorOffset && facing < 0.0) {
+        agent.angle += direction.x * wall.z - direction.y * wall.y >= 0.0 ? turn : -turn;
+    }
+}
+#endif
+
+// Keeps the tile at pos in the sparse diffusion kernel's list. Most agents
+// find the flag already set and skip the atomic.
+void mark_tile(ivec2 pos) {
+    int tile = tile_index(pos, int(SCREEN_WIDTH));
+    if ((tileFlags[tile] & TILE_AGENT) == 0u) {
+        atomicOr(tileFlags[tile], TILE_AGENT);
+    }
+}
+
+// Adds amount, in DEPOSIT_ONE units, to the species' layer of the counts
+// at pos
+void deposit(ivec2 pos, int species, uint amount) {
+    if (amount == 0u) {
+        return;
+    }
+    imageAtomicAdd(deposits, ivec3(pos, species), amount);
+    mark_tile(pos);
+}
+
 // Main function to update the agents and store their trails
 void main() {
-    uint agentID = gl_GlobalInvocationID.x;  // Get the ID of the current agent
+    uint agentID = agent_index();  // Get the ID of the current agent
     
     if (agentID >= NUM_AGENTS) {
         return;  // Skip if agent ID exceeds the total number of agents
@@ -121,24 +194,29 @@ void main() {
     // Retrieve the agent's data from the buffer
     Agent agent = agents[agentID];
 
-    // Generate a random value for the agent based on its position and the current time
-    uint randomState = hash(agentID + uint(agent.x * 100 + agent.y) + uint(time * 10));
-    // float randomAngleVariation = scaleToRange01(randomState) * 2.0 * RANDOM_TURN - RANDOM_TURN;  // Random angle change
+    // Generate a random value for the agent from its ID and the step
+    float random = random_unit(random_bits(seed, agentID, stepIndex, STREAM_STEER).x);
+    // float randomAngleVariation = random * 2.0 * randomTurn - randomTurn;  // Random angle change
 
     // // Apply the random angle variation to the agent's current angle
     // agent.angle += randomAngleVariation;
 
     // Calculate the agent's movement speed adjusted by deltaTime
-    float speed = BASE_SPEED * deltaTime;  // Adjust movement based on deltaTime
+    float speed = baseSpeed * deltaTime;  // Adjust movement based on deltaTime
+
+#if SENSE_RULE == SENSE_SIMILARITY
+    for (int layer = 0; layer < TRAIL_LAYERS; ++layer) {
+        trailHere[layer] = read_trail(vec2(agent.x, agent.y), layer);
+    }
+#endif
 
     // Sense the environment
     float weightForward = sense(agent, 0.0);  // Forward sensing
-    float weightLeft = sense(agent, 3.1415 / 8.0);  // Left sensing (45 degrees)
-    float weightRight = sense(agent, -3.1415 / 8.0); // Right sensing (-45 degrees)
+    float weightLeft = sense(agent, sensorAngle);  // Left sensing
+    float weightRight = sense(agent, -sensorAngle); // Right sensing
 
     // Decision making based on sensed environment
-    float randomSteerStrength = scaleToRange01(randomState) + 0.2; // from .2 to 1.2
-    float turnSpeed = 0.1 * 3.1415; // Arbitrary turn speed factor
+    float randomSteerStrength = random + 0.2; // from .2 to 1.2
 
     // If the forward direction is clear, keep going straight
     if (weightForward > weightLeft && weightForward > weightRight) {
@@ -149,37 +227,61 @@ void main() {
         agent.angle -= randomSteerStrength * turnSpeed;  // Turn right
     }
 
+#ifdef OBSTACLES
+    // Positions are brought onto the grid at the end of every step but not
+    // yet on the first
+    ivec2 pixel = position_pixel(vec2(agent.x, agent.y), ivec2(SCREEN_WIDTH, SCREEN_HEIGHT));
+    vec4 wall = texelFetch(obstacleField, pixel, 0);
+#endif
+
     // Update agent's position based on its angle and speed
-    agent.x += cos(agent.angle) * speed;
-    agent.y += sin(agent.angle) * speed;
+    vec2 direction = vec2(cos(agent.angle), sin(agent.angle));
+    agent.x += direction.x * speed;
+    agent.y += direction.y * speed;
 
-    // Introduce some randomness to the movement for wiggling effect
-    agent.angle += randomSteerStrength * RANDOM_TURN;
+#ifdef OBSTACLES
+    bounceOffObstacles(agent, wall, direction, speed, randomSteerStrength * turnSpeed);
+#endif
 
+    // Introduce some randomness to the movement for wiggling effect
+    agent.angle += randomSteerStrength * randomTurn;
+
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+    // Out over one edge, back in over the opposite one
+    vec2 wrapped = mod(vec2(agent.x, agent.y), vec2(SCREEN_WIDTH, SCREEN_HEIGHT));
+    agent.x = wrapped.x;
+    agent.y = wrapped.y;
+#else
     // Reflect agent's direction if it hits the screen boundaries (bounce effect)
     bounceOffWalls(agent);
 
     // Ensure the agent's position stays within the screen bounds
     agent.x = clamp(agent.x, 0.0, float(SCREEN_WIDTH - 1));
     agent.y = clamp(agent.y, 0.0, float(SCREEN_HEIGHT - 1));
-
+#endif
+    ivec2 gridSize = ivec2(SCREEN_WIDTH, SCREEN_HEIGHT);
+
+#if DEPOSIT_MODE == DEPOSIT_RASTER
+    // deposit_points.vert draws the deposit once diffusion has run, which
+    // only has to list the tile
+    mark_tile(position_pixel(vec2(agent.x, agent.y), gridSize));
+#elif DEPOSIT_MODE == DEPOSIT_BILINEAR
+    // Split between the four pixels whose centres surround the agent, in
+    // sixteenths of a pixel along each axis, so the weights always add up
+    // to exactly one deposit. Splats over the edge land on the edge pixels,
+    // or across the torus.
+    vec2 splat = vec2(agent.x, agent.y) - 0.5;
+    ivec2 corner = ivec2(floor(splat));
+    uvec2 far = uvec2((splat - vec2(corner)) * 16.0 + 0.5);
+    uvec2 near = 16u - far;
+    deposit(grid_pixel(corner, gridSize), agent.species, near.x * near.y);
+    deposit(grid_pixel(corner + ivec2(1, 0), gridSize), agent.species, far.x * near.y);
+    deposit(grid_pixel(corner + ivec2(0, 1), gridSize), agent.species, near.x * far.y);
+    deposit(grid_pixel(corner + ivec2(1, 1), gridSize), agent.species, far.x * far.y);
+#else
     // Convert agent's position to integer coordinates for the trail texture
-    ivec2 intPos = ivec2(floor(agent.x), floor(agent.y));
-
-    // Assign a color based on the agent's species
-    ivec4 color = ivec4(0, 0, 0, 0); // Default color (black)
-
-    // Map species to color
-    if (agent.species == 0) {
-        color = ivec4(1.0, 0.0, .0, 1.0);  // Red for species 0
-    } else if (agent.species == 1) {
-        color = ivec4(0.0, 1.0, 0.0, 1.0);  // Green for species 1
-    } else if (agent.species == 2) {
-        color = ivec4(0.0, 0.0, 1.0, 1.0);  // Blue for species 2
-    }
-
-    // Store the color in the trail texture at the agent's position
-    imageStore(trailMap, intPos, color);
+    deposit(position_pixel(vec2(agent.x, agent.y), gridSize), agent.species, DEPOSIT_ONE);
+#endif
 
     // Optionally update the agent's position for the next frame
     agents[agentID] = agent;
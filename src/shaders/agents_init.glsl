@@ -0,0 +1,81 @@
+#version 450 core
+
+#include "sim_params.glsl"
+#include "random.glsl"
+
+// Writes every agent's starting state in place, the GPU side of
+// spawn_agent() in spawn.cpp. Runs once, so the size isn't tuned.
+layout (local_size_x = 256) in;
+
+#include "agent.glsl"
+
+// Must match spawn.h
+const float SPAWN_RADIUS = 0.45;
+const float RING_WIDTH = 0.05;
+
+const int SPAWN_UNIFORM = 0;  // SpawnPattern in settings.h
+const int SPAWN_DISC = 1;
+const int SPAWN_RING = 2;
+const int SPAWN_IMAGE = 3;
+
+uniform int pattern;
+
+// SpawnImage's two-level alias table, (threshold, alias) per entry: one
+// per row first, then one per pixel
+layout(std430, binding = 4) readonly buffer SpawnTable {
+    uvec2 spawnTable[];
+};
+uniform uvec2 spawnImageSize;
+uniform vec2 spawnScale;  // Grid pixels per image pixel
+
+// Index picked from the alias table starting at offset, see AliasEntry in
+// spawn.h
+uint alias_sample(uint offset, uint count, uint indexBits, uint thresholdBits) {
+    uint i, unused;
+    umulExtended(indexBits, count, i, unused);
+    uvec2 entry = spawnTable[offset + i];
+    return thresholdBits < entry.x ? i : entry.y;
+}
+
+void main() {
+    uint agentID = agent_index();
+    if (agentID >= NUM_AGENTS) {
+        return;
+    }
+
+    Agent agent;
+    agent.species = int(agentID % uint(SPECIES_COUNT));  // Species take turns
+
+    uvec4 bits = random_bits(seed, agentID, 0u, STREAM_SPAWN);
+    float width = float(SCREEN_WIDTH);
+    float height = float(SCREEN_HEIGHT);
+    float radius = SPAWN_RADIUS * min(width, height);
+    if (pattern == SPAWN_DISC) {
+        // sqrt keeps the density even, r alone would crowd the centre
+        float r = radius * sqrt(random_unit(bits.x));
+        float theta = random_unit(bits.y) * 2.0 * 3.14159;
+        agent.x = width * 0.5 + r * cos(theta);
+        agent.y = height * 0.5 + r * sin(theta);
+        agent.angle = random_unit(bits.z) * 2.0 * 3.14159;
+    } else if (pattern == SPAWN_RING) {
+        float r = radius * (1.0 - RING_WIDTH * random_unit(bits.x));
+        float theta = random_unit(bits.y) * 2.0 * 3.14159;
+        agent.x = width * 0.5 + r * cos(theta);
+        agent.y = height * 0.5 + r * sin(theta);
+        agent.angle = theta + 3.14159;  // Facing the centre
+    } else if (pattern == SPAWN_IMAGE) {
+        // Row, then pixel within the row, then a point within the pixel
+        uint row = alias_sample(0u, spawnImageSize.y, bits.x, bits.y);
+        uint column = alias_sample(spawnImageSize.y + row * spawnImageSize.x, spawnImageSize.x, bits.z, bits.w);
+        bits = random_bits(seed, agentID, 1u, STREAM_SPAWN);
+        agent.x = (float(column) + random_unit(bits.x)) * spawnScale.x;
+        agent.y = (float(row) + random_unit(bits.y)) * spawnScale.y;
+        agent.angle = random_unit(bits.z) * 2.0 * 3.14159;
+    } else {
+        agent.x = random_unit(bits.x) * width;
+        agent.y = random_unit(bits.y) * height;
+        agent.angle = random_unit(bits.z) * 2.0 * 3.14159;
+    }
+
+    agents[agentID] = agent;
+}
@@ -0,0 +1,30 @@
+// settings.h's BoundaryMode, shared by the agent and diffusion passes.
+// Bounce keeps agents inside the grid and blurs over the pixels in it;
+// wrap joins opposite edges into a torus, so patterns tile seamlessly and
+// every pixel has a full neighbourhood.
+#define BOUNDARY_BOUNCE 0
+#define BOUNDARY_WRAP 1
+#ifndef BOUNDARY_MODE
+#define BOUNDARY_MODE BOUNDARY_BOUNCE
+#endif
+
+// The pixel of a size grid that stands in for p: the nearest edge pixel
+// when bouncing, the one across the torus when wrapping. Wrapping takes p
+// at most one size outside the grid, which is all a blur or a splat
+// reaches, and selects instead of branching.
+ivec2 grid_pixel(ivec2 p, ivec2 size) {
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+    return p + size * (ivec2(lessThan(p, ivec2(0))) - ivec2(greaterThanEqual(p, size)));
+#else
+    return clamp(p, ivec2(0), size - 1);
+#endif
+}
+
+// The pixel under pos, which may be anywhere when wrapping. mod() can round
+// up to size itself, which grid_pixel() takes back to 0.
+ivec2 position_pixel(vec2 pos, ivec2 size) {
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+    pos = mod(pos, vec2(size));
+#endif
+    return grid_pixel(ivec2(floor(pos)), size);
+}
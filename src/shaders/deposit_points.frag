@@ -0,0 +1,19 @@
+#version 450 core
+
+#include "sim_params.glsl"
+#include "trail.glsl"
+#include "deposits.glsl"
+
+// Every trail layer is its own colour attachment, see main.cpp, so each
+// point adds depositAmount to one channel of one of them and zero elsewhere
+
+flat in int species;
+layout(location = 0) out vec4 layerDeposits[TRAIL_LAYERS];
+
+void main() {
+    int depositLayer = species / TRAIL_CHANNELS;
+    vec4 amount = vec4(equal(ivec4(0, 1, 2, 3), ivec4(species % TRAIL_CHANNELS))) * depositAmount;
+    for (int layer = 0; layer < TRAIL_LAYERS; ++layer) {
+        layerDeposits[layer] = layer == depositLayer ? amount : vec4(0.0);
+    }
+}
@@ -0,0 +1,23 @@
+#version 450 core
+
+// DEPOSIT_RASTER: one point per agent, pulled straight from the agent
+// buffer by gl_VertexID with no vertex attributes. Drawn into frame N+1
+// after diffusion with additive blending, so the blend units sum agents
+// that share a pixel instead of atomics. Same pixel as the point deposit
+// in agents.glsl.
+
+#include "sim_params.glsl"
+#include "boundary.glsl"
+#define AGENT_VERTICES
+#include "agent.glsl"
+
+flat out int species;
+
+void main() {
+    Agent agent = agents[gl_VertexID];
+
+    // Pixel centre, so the one pixel point covers exactly that pixel
+    vec2 pixel = vec2(position_pixel(vec2(agent.x, agent.y), ivec2(SCREEN_WIDTH, SCREEN_HEIGHT))) + 0.5;
+    gl_Position = vec4(pixel / vec2(SCREEN_WIDTH, SCREEN_HEIGHT) * 2.0 - 1.0, 0.0, 1.0);
+    species = agent.species;
+}
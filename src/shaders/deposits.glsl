@@ -0,0 +1,33 @@
+// Per-species deposit counts, one r32ui layer per species. The agent pass
+// adds to them atomically, the diffusion pass adds them to the trail and
+// clears them. Needs sim_params.glsl and trail.glsl first.
+layout(binding = 3, r32ui) uniform uimage2DArray deposits;
+
+// Counts are fixed point so bilinear splats can add fractions of a
+// deposit: one deposit is DEPOSIT_ONE, which leaves room for 16M of them
+// per pixel and frame. Scaling by a power of two keeps whole counts exact.
+const uint DEPOSIT_ONE = 256u;
+
+// settings.h's DepositMode: the pixel under the agent, a bilinear splat
+// over the four around it, or the pixel under the agent drawn into the
+// trail after diffusion, which leaves these counts at zero
+#define DEPOSIT_POINT 0
+#define DEPOSIT_BILINEAR 1
+#define DEPOSIT_RASTER 2
+#ifndef DEPOSIT_MODE
+#define DEPOSIT_MODE DEPOSIT_POINT
+#endif
+
+// Adds this pixel's deposits to one layer of the trail and clears them for
+// the next agent pass
+vec4 take_deposits(vec4 color, ivec2 pos, int layer) {
+    for (int channel = 0; channel < TRAIL_CHANNELS; ++channel) {
+        int species = layer * TRAIL_CHANNELS + channel;
+        if (species < SPECIES_COUNT) {
+            ivec3 depositPos = ivec3(pos, species);
+            color[channel] += float(imageLoad(deposits, depositPos).r) * (depositAmount / float(DEPOSIT_ONE));
+            imageStore(deposits, depositPos, uvec4(0u));
+        }
+    }
+    return color;
+}
@@ -0,0 +1,85 @@
+#version 450 core
+
+// Box blur for large radii. Each invocation walks one whole row (horizontal
+// pass) or column (vertical pass) keeping a running sum: one add and one
+// subtract per pixel whatever the radius. Bindings and the final blend and
+// decay match diffusion_separable.glsl.
+
+#include "sim_params.glsl"
+#include "trail.glsl"
+#include "deposits.glsl"
+#include "boundary.glsl"
+
+// Tuned by the host, see workgroup_tuner.h
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout (local_size_x = LOCAL_SIZE_X) in;
+
+layout(binding = 0, TRAIL_FORMAT) readonly uniform image2DArray blurInput;
+layout(binding = 1, TRAIL_FORMAT) writeonly uniform image2DArray blurOutput;
+layout(binding = 2, TRAIL_FORMAT) readonly uniform image2DArray trailMap;
+
+layout(location = 0) uniform bool vertical;  // false: one invocation per row, true: per column
+
+void main() {
+    ivec2 size = imageSize(blurInput).xy;
+    ivec2 axis = vertical ? ivec2(0, 1) : ivec2(1, 0);
+    int length = vertical ? size.y : size.x;
+    int lineCount = vertical ? size.x : size.y;
+
+    int line = int(gl_GlobalInvocationID.x);
+    int layer = int(gl_GlobalInvocationID.y);  // One row of workgroups per trail layer
+    if (line >= lineCount) {
+        return;
+    }
+    ivec2 origin = (ivec2(1) - axis) * line;
+
+    // Window for the first pixel: [0, radius], or [-radius, radius] on the
+    // torus
+    vec4 sum = vec4(0.0);
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+    for (int i = -radius; i <= radius; ++i) {
+        sum += imageLoad(blurInput, ivec3(grid_pixel(origin + axis * i, size), layer));
+    }
+#else
+    for (int i = 0; i <= min(radius, length - 1); ++i) {
+        sum += imageLoad(blurInput, ivec3(origin + axis * i, layer));
+    }
+#endif
+
+    for (int i = 0; i < length; ++i) {
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+        int count = 2 * radius + 1;
+#else
+        int count = min(i + radius, length - 1) - max(i - radius, 0) + 1;
+#endif
+        vec4 average = sum / float(count);
+        ivec2 pos = origin + axis * i;
+
+        if (vertical) {
+            vec4 currentColor = imageLoad(trailMap, ivec3(pos, layer));
+            currentColor = mix(currentColor, average, diffuseWeight);
+            currentColor = max(currentColor - deltaTime * decayRate * species_mask(layer), 0.0);
+
+            currentColor = take_deposits(currentColor, pos, layer);
+
+            imageStore(blurOutput, ivec3(pos, layer), currentColor);
+        } else {
+            imageStore(blurOutput, ivec3(pos, layer), average);
+        }
+
+        // Slide the window one pixel along the line
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+        sum += imageLoad(blurInput, ivec3(grid_pixel(origin + axis * (i + radius + 1), size), layer));
+        sum -= imageLoad(blurInput, ivec3(grid_pixel(origin + axis * (i - radius), size), layer));
+#else
+        if (i + radius + 1 < length) {
+            sum += imageLoad(blurInput, ivec3(origin + axis * (i + radius + 1), layer));
+        }
+        if (i - radius >= 0) {
+            sum -= imageLoad(blurInput, ivec3(origin + axis * (i - radius), layer));
+        }
+#endif
+    }
+}
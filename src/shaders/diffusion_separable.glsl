@@ -0,0 +1,64 @@
+#version 450 core
+
+// Box blur split into a horizontal and a vertical pass, 2 * radius + 1
+// loads per pixel per pass instead of (2 * radius + 1)^2. Averaging each
+// pass over its in-bounds taps, or all of them on the torus, gives the
+// same edge handling as diffusion_shader.glsl. The vertical pass also
+// blends and decays.
+
+#include "sim_params.glsl"
+#include "trail.glsl"
+#include "deposits.glsl"
+#include "boundary.glsl"
+
+// Tuned by the host, see workgroup_tuner.h
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 16
+#define LOCAL_SIZE_Y 16
+#endif
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y) in;
+
+layout(binding = 0, TRAIL_FORMAT) readonly uniform image2DArray blurInput;    // trailMap, then the horizontal result
+layout(binding = 1, TRAIL_FORMAT) writeonly uniform image2DArray blurOutput;  // horizontal result, then diffusedTrailMap
+layout(binding = 2, TRAIL_FORMAT) readonly uniform image2DArray trailMap;     // Unblurred frame N, vertical pass only
+
+layout(location = 0) uniform bool vertical;  // false: horizontal pass, true: vertical pass
+
+void main() {
+    ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+    int layer = int(gl_GlobalInvocationID.z);
+    ivec2 size = imageSize(blurInput).xy;
+    if (pos.x >= size.x || pos.y >= size.y) {
+        return;
+    }
+
+    ivec2 axis = vertical ? ivec2(0, 1) : ivec2(1, 0);
+    int coord = vertical ? pos.y : pos.x;
+    int length = vertical ? size.y : size.x;
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+    int first = coord - radius;
+    int last = coord + radius;
+#else
+    int first = max(coord - radius, 0);
+    int last = min(coord + radius, length - 1);
+#endif
+
+    vec4 sum = vec4(0.0);
+    for (int i = first - coord; i <= last - coord; ++i) {
+        sum += imageLoad(blurInput, ivec3(grid_pixel(pos + axis * i, size), layer));
+    }
+    vec4 average = sum / float(last - first + 1);
+
+    if (!vertical) {
+        imageStore(blurOutput, ivec3(pos, layer), average);
+        return;
+    }
+
+    vec4 currentColor = imageLoad(trailMap, ivec3(pos, layer));
+    currentColor = mix(currentColor, average, diffuseWeight);
+    currentColor = max(currentColor - deltaTime * decayRate * species_mask(layer), 0.0);
+
+    currentColor = take_deposits(currentColor, pos, layer);
+
+    imageStore(blurOutput, ivec3(pos, layer), currentColor);
+}
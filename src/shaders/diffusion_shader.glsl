@@ -1,31 +1,53 @@
 #version 450 core
 
-layout (local_size_x = 16, local_size_y = 16) in;
+#include "sim_params.glsl"
+#include "trail.glsl"
+#include "deposits.glsl"
+#include "boundary.glsl"
 
-layout(binding = 0, rgba32f) uniform image2D trailMap;  // The trail texture
+// Tuned by the host, see workgroup_tuner.h
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 16
+#define LOCAL_SIZE_Y 16
+#endif
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y) in;
 
-float decayRate = 0.4;  // Rate at which trail fades
-uniform float deltaTime;   // Time passed since last frame
+// Reads frame N and writes frame N+1, so every pixel sees the same
+// neighbours no matter which invocations run first. One z slice of the
+// dispatch per trail layer.
+layout(binding = 0, TRAIL_FORMAT) readonly uniform image2DArray trailMap;
+layout(binding = 1, TRAIL_FORMAT) writeonly uniform image2DArray diffusedTrailMap;
 
 void main() {
     ivec2 pos = ivec2(gl_GlobalInvocationID.xy);  // Get pixel position
+    int layer = int(gl_GlobalInvocationID.z);
+    if (pos.x >= imageSize(trailMap).x || pos.y >= imageSize(trailMap).y) {
+        return;  // The dispatch rounds up to whole workgroups
+    }
+
+    ivec2 size = imageSize(trailMap).xy;
 
     // Read the current color at this pixel
-    vec4 currentColor = imageLoad(trailMap, pos);
+    vec4 currentColor = imageLoad(trailMap, ivec3(pos, layer));
 
     // Get average of the surrounding pixels
     vec4 sum = vec4(0.0);
     int count = 0;
-    for (int x = -1; x <= 1; ++x) {
-        for (int y = -1; y <= 1; ++y) {
+    for (int x = -radius; x <= radius; ++x) {
+        for (int y = -radius; y <= radius; ++y) {
             ivec2 neighborPos = pos + ivec2(x, y);
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+            // Every neighbour exists on the torus
+            neighborPos = grid_pixel(neighborPos, size);
+#else
             // Ensure neighbor position is within bounds
-            if (neighborPos.x < 0 || neighborPos.x >= imageSize(trailMap).x ||
-                neighborPos.y < 0 || neighborPos.y >= imageSize(trailMap).y) {
+            if (neighborPos.x < 0 || neighborPos.x >= size.x ||
+                neighborPos.y < 0 || neighborPos.y >= size.y) {
                 continue;  // Skip out-of-bounds neighbors
             }
+#endif
             // Load the color of the neighbor pixel
-            vec4 neighborColor = imageLoad(trailMap, neighborPos);
+            vec4 neighborColor = imageLoad(trailMap, ivec3(neighborPos, layer));
             sum += neighborColor;
             count++;
         }
@@ -36,14 +58,15 @@ void main() {
         sum /= float(count);
     }
 
-    currentColor = mix(currentColor, sum, 0.1);  // Blend current color with average
+    currentColor = mix(currentColor, sum, diffuseWeight);  // Blend current color with average
     //currentColor = mix(currentColor, vec4(0.0, 0.0, 0.0, 1.0), 0.1);  // Blend with black
 
-    // Apply decay to the color's alpha channel (transparency)
-    currentColor.r -= deltaTime * decayRate;  // Reduce red over time
-    currentColor.g -= deltaTime * decayRate;  // Reduce green over time
-    currentColor.b -= deltaTime * decayRate;  // Reduce blue over time
+    // Reduce every species' trail over time, stopping at zero so empty
+    // areas stay exactly empty (see diffusion_sparse.glsl)
+    currentColor = max(currentColor - deltaTime * decayRate * species_mask(layer), 0.0);
+
+    currentColor = take_deposits(currentColor, pos, layer);
 
-    // Store the updated color back into the texture
-    imageStore(trailMap, pos, currentColor);
+    // Store the updated color into the next frame's texture
+    imageStore(diffusedTrailMap, ivec3(pos, layer), currentColor);
 }
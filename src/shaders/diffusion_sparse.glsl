@@ -0,0 +1,93 @@
+#version 450 core
+
+// Same blur and decay as diffusion_shader.glsl, but only over the tiles
+// diffusion_tile_list.glsl found active. Each workgroup covers one tile and
+// the dispatch is indirect, so empty parts of the map cost nothing.
+
+#include "sim_params.glsl"
+#include "trail.glsl"
+#include "deposits.glsl"
+#include "tiles.glsl"
+#include "boundary.glsl"
+
+// Tuned by the host, see workgroup_tuner.h. Each invocation strides over
+// the tile.
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 16
+#define LOCAL_SIZE_Y 16
+#endif
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y) in;
+
+// Workgroup x indexes the tile list, z is the trail layer
+layout(binding = 0, TRAIL_FORMAT) readonly uniform image2DArray trailMap;
+layout(binding = 1, TRAIL_FORMAT) writeonly uniform image2DArray diffusedTrailMap;
+
+layout(std430, binding = 3) readonly buffer TileList {
+    uint numGroupsX;
+    uint numGroupsY;
+    uint numGroupsZ;
+    uint tiles[];
+};
+
+layout(location = 0) uniform uint parity;  // Frame number & 1
+
+shared bool tileHasTrail;
+
+void main() {
+    if (gl_LocalInvocationIndex == 0u) {
+        tileHasTrail = false;
+    }
+    barrier();
+
+    uint packedTile = tiles[gl_WorkGroupID.x];
+    ivec2 tileOrigin = ivec2(packedTile & 0xffffu, packedTile >> 16) * ACTIVITY_TILE_SIZE;
+    int layer = int(gl_WorkGroupID.z);
+    ivec2 size = imageSize(trailMap).xy;
+
+    bool hasTrail = false;
+    for (int ty = int(gl_LocalInvocationID.y); ty < ACTIVITY_TILE_SIZE; ty += LOCAL_SIZE_Y) {
+        for (int tx = int(gl_LocalInvocationID.x); tx < ACTIVITY_TILE_SIZE; tx += LOCAL_SIZE_X) {
+            ivec2 pos = tileOrigin + ivec2(tx, ty);
+            if (pos.x >= size.x || pos.y >= size.y) {
+                continue;
+            }
+
+            // Average of the in-bounds neighbourhood, or all of it on the
+            // torus, summed in the same order as diffusion_shader.glsl
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+            ivec2 low = pos - radius;
+            ivec2 high = pos + radius;
+#else
+            ivec2 low = max(pos - radius, ivec2(0));
+            ivec2 high = min(pos + radius, size - 1);
+#endif
+            vec4 sum = vec4(0.0);
+            for (int x = low.x; x <= high.x; ++x) {
+                for (int y = low.y; y <= high.y; ++y) {
+                    sum += imageLoad(trailMap, ivec3(grid_pixel(ivec2(x, y), size), layer));
+                }
+            }
+            ivec2 span = high - low + 1;
+
+            vec4 currentColor = imageLoad(trailMap, ivec3(pos, layer));
+            currentColor = mix(currentColor, sum / float(span.x * span.y), diffuseWeight);
+            currentColor = max(currentColor - deltaTime * decayRate * species_mask(layer), 0.0);
+            currentColor = take_deposits(currentColor, pos, layer);
+            imageStore(diffusedTrailMap, ivec3(pos, layer), currentColor);
+
+            // Channels without a species don't count, r11g11b10f loads 1.0
+            // for the missing alpha
+            hasTrail = hasTrail || any(greaterThan(currentColor * species_mask(layer), vec4(0.0)));
+        }
+    }
+
+    if (hasTrail) {
+        tileHasTrail = true;
+    }
+    barrier();
+
+    // Marks the tile for the next frame's list
+    if (gl_LocalInvocationIndex == 0u && tileHasTrail) {
+        atomicOr(tileFlags[tile_index(tileOrigin, size.x)], TILE_TRAIL << (1u - parity));
+    }
+}
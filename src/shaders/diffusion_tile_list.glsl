@@ -0,0 +1,73 @@
+#version 450 core
+
+// Lists the tiles diffusion_sparse.glsl has to run on this frame and sets
+// up its indirect dispatch, one workgroup per tile. A tile is left out if
+// it and its neighbours have no trail and no agent deposited in it, which
+// makes its blurred output zero. It also has to be zero already in the
+// output texture, which holds the frame before, or stale trail would be
+// read back next frame.
+
+#include "tiles.glsl"
+#include "boundary.glsl"
+
+layout (local_size_x = 64) in;  // One invocation per tile
+
+layout(std430, binding = 3) buffer TileList {
+    uint numGroupsX;  // glDispatchComputeIndirect arguments, the host
+    uint numGroupsY;  // resets x to zero
+    uint numGroupsZ;
+    uint tiles[];     // x | y << 16
+};
+
+layout(location = 0) uniform ivec2 tileCount;
+layout(location = 1) uniform uint parity;  // Frame number & 1
+
+void main() {
+    int index = int(gl_GlobalInvocationID.x);
+    if (index >= tileCount.x * tileCount.y) {
+        return;
+    }
+    ivec2 tile = ivec2(index % tileCount.x, index / tileCount.x);
+    uint currentTrail = TILE_TRAIL << parity;
+    uint previousTrail = TILE_TRAIL << (1u - parity);
+
+    // The blur radius is at most a tile, so only direct neighbours can
+    // spread trail into this one
+    bool needed = (tileFlags[index] & (TILE_AGENT | previousTrail)) != 0u;
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+    // On the torus that includes the tiles across the seam. The last tile
+    // of a row or column can be narrower than the radius, so there the
+    // one past it counts as well.
+    for (int dy = -2; dy <= 2; ++dy) {
+        for (int dx = -2; dx <= 2; ++dx) {
+            ivec2 neighbour = tile + ivec2(dx, dy);
+            bvec2 seam = bvec2(neighbour.x < 0 || neighbour.x >= tileCount.x,
+                               neighbour.y < 0 || neighbour.y >= tileCount.y);
+            if ((abs(dx) == 2 && !seam.x) || (abs(dy) == 2 && !seam.y)) {
+                continue;
+            }
+            neighbour = (neighbour + 2 * tileCount) % tileCount;
+            needed = needed || (tileFlags[neighbour.y * tileCount.x + neighbour.x] & currentTrail) != 0u;
+        }
+    }
+#else
+    for (int y = max(tile.y - 1, 0); y <= min(tile.y + 1, tileCount.y - 1); ++y) {
+        for (int x = max(tile.x - 1, 0); x <= min(tile.x + 1, tileCount.x - 1); ++x) {
+            needed = needed || (tileFlags[y * tileCount.x + x] & currentTrail) != 0u;
+        }
+    }
+#endif
+
+    if (needed) {
+        tiles[atomicAdd(numGroupsX, 1u)] = uint(tile.x) | uint(tile.y) << 16;
+    }
+
+    // Neighbours only read the current bit, so clearing the others is safe.
+    // Deposits always leave trail in the output; the diffusion pass sets
+    // the bit for the others, but raster deposits (DEPOSIT_RASTER) are
+    // drawn after it and never seen there.
+    uint flags = atomicAnd(tileFlags[index], ~(TILE_AGENT | previousTrail));
+    if ((flags & TILE_AGENT) != 0u) {
+        atomicOr(tileFlags[index], previousTrail);
+    }
+}
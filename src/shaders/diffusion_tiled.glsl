@@ -0,0 +1,70 @@
+#version 450 core
+
+// Same blur and decay as diffusion_shader.glsl, but each workgroup loads its
+// 16x16 tile plus a one pixel halo into shared memory once and blurs from
+// there: 18*18 imageLoads per 256 pixels instead of 9 per pixel.
+
+#include "sim_params.glsl"
+#include "trail.glsl"
+#include "deposits.glsl"
+#include "boundary.glsl"
+
+layout (local_size_x = 16, local_size_y = 16) in;
+
+// Workgroup z is the trail layer
+layout(binding = 0, TRAIL_FORMAT) readonly uniform image2DArray trailMap;
+layout(binding = 1, TRAIL_FORMAT) writeonly uniform image2DArray diffusedTrailMap;
+
+const int TILE_SIZE = 16;
+const int HALO_SIZE = TILE_SIZE + 2;
+shared vec4 tile[HALO_SIZE][HALO_SIZE];
+
+void main() {
+    ivec2 size = imageSize(trailMap).xy;
+    int layer = int(gl_WorkGroupID.z);
+    ivec2 haloOrigin = ivec2(gl_WorkGroupID.xy) * TILE_SIZE - 1;
+
+    // 324 halo texels shared between 256 invocations
+    for (int i = int(gl_LocalInvocationIndex); i < HALO_SIZE * HALO_SIZE; i += TILE_SIZE * TILE_SIZE) {
+        ivec2 local = ivec2(i % HALO_SIZE, i / HALO_SIZE);
+        ivec2 texel = haloOrigin + local;
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+        tile[local.y][local.x] = imageLoad(trailMap, ivec3(grid_pixel(texel, size), layer));
+#else
+        bool inside = all(greaterThanEqual(texel, ivec2(0))) && all(lessThan(texel, size));
+        tile[local.y][local.x] = inside ? imageLoad(trailMap, ivec3(texel, layer)) : vec4(0.0);
+#endif
+    }
+    barrier();
+
+    ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+    if (pos.x >= size.x || pos.y >= size.y) {
+        return;
+    }
+
+    ivec2 center = ivec2(gl_LocalInvocationID.xy) + 1;
+    vec4 sum = vec4(0.0);
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            sum += tile[center.y + y][center.x + x];
+        }
+    }
+
+#if BOUNDARY_MODE == BOUNDARY_WRAP
+    ivec2 span = ivec2(3);
+#else
+    // Out-of-bounds neighbours were loaded as zero, so only the count needs
+    // fixing up at the edges
+    ivec2 low = max(pos - 1, ivec2(0));
+    ivec2 high = min(pos + 1, size - 1);
+    ivec2 span = high - low + 1;
+#endif
+    vec4 currentColor = tile[center.y][center.x];
+    currentColor = mix(currentColor, sum / float(span.x * span.y), diffuseWeight);
+
+    currentColor = max(currentColor - deltaTime * decayRate * species_mask(layer), 0.0);
+
+    currentColor = take_deposits(currentColor, pos, layer);
+
+    imageStore(diffusedTrailMap, ivec3(pos, layer), currentColor);
+}
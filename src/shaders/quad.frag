@@ -1,11 +1,25 @@
 #version 450 core
 
+#include "trail.glsl"
+
 in vec2 TexCoords; // Passed from vertex shader
 out vec4 FragColor;
 
-uniform sampler2D noiseTexture; // Sampler for the noise texture
+uniform sampler2DArray noiseTexture; // Trail layers, see trail.glsl
+uniform vec3 speciesColors[SPECIES_COUNT];  // Display colour of each species
 
 void main() {
-    // Sample the texture at the given texture coordinates
-    FragColor = texture(noiseTexture, TexCoords);
+    // Sum every species' trail tinted by its colour. Negative trail (decayed
+    // past zero in the float formats) shows as black.
+    vec3 color = vec3(0.0);
+    for (int layer = 0; layer < TRAIL_LAYERS; ++layer) {
+        vec4 trail = max(texture(noiseTexture, vec3(TexCoords, layer)), 0.0);
+        for (int channel = 0; channel < TRAIL_CHANNELS; ++channel) {
+            int species = layer * TRAIL_CHANNELS + channel;
+            if (species < SPECIES_COUNT) {
+                color += trail[channel] * speciesColors[species];
+            }
+        }
+    }
+    FragColor = vec4(color, 1.0);
 }
@@ -5,7 +5,9 @@ layout (location = 1) in vec2 aTexCoord;
 
 out vec2 TexCoords;
 
+uniform vec2 scale;  // Fraction of the window the grid covers on each axis
+
 void main() {
-    gl_Position = vec4(aPos, 0.0, 1.0);
+    gl_Position = vec4(aPos * scale, 0.0, 1.0);
     TexCoords = aTexCoord;
 }
@@ -0,0 +1,33 @@
+// Philox4x32-10 keyed by (seed, agent, step), the same generator as
+// philox.h so the CPU and GPU draw bit-identical numbers. See there for the
+// details; the two have to change together.
+const uint PHILOX_M0 = 0xD2511F53u;
+const uint PHILOX_M1 = 0xCD9E8D57u;
+const uint PHILOX_W0 = 0x9E3779B9u;
+const uint PHILOX_W1 = 0xBB67AE85u;
+
+// Third counter word, philox::Stream
+const uint STREAM_STEER = 0u;
+const uint STREAM_SPAWN = 1u;
+
+uvec4 philox4x32(uvec4 counter, uvec2 key) {
+    for (int round = 0; round < 10; ++round) {
+        if (round > 0) {
+            key += uvec2(PHILOX_W0, PHILOX_W1);
+        }
+        uint high0, low0, high1, low1;
+        umulExtended(PHILOX_M0, counter.x, high0, low0);
+        umulExtended(PHILOX_M1, counter.z, high1, low1);
+        counter = uvec4(high1 ^ counter.y ^ key.x, low1, high0 ^ counter.w ^ key.y, low0);
+    }
+    return counter;
+}
+
+uvec4 random_bits(uint seed, uint id, uint stepIndex, uint stream) {
+    return philox4x32(uvec4(id, stepIndex, stream, 0u), uvec2(seed, 0u));
+}
+
+// Top 24 bits in [0, 1), exact
+float random_unit(uint bits) {
+    return float(bits >> 8) * (1.0 / 16777216.0);
+}
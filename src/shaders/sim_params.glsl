@@ -0,0 +1,24 @@
+// Everything the passes read per frame or per run, and the tunables that
+// used to be constants in the shaders, laid out like SimParams in
+// sim_params.h. The host pushes a copy before the passes that read it, so
+// changing a value never recompiles a shader.
+layout(std140, binding = 1) uniform SimParams {
+    float deltaTime;      // Time passed since last frame
+    uint stepIndex;       // Frames since the start
+    uint seed;            // Random numbers are keyed by seed, agent and step
+    uint NUM_AGENTS;      // Number of agents to process
+    uint SCREEN_WIDTH;    // Simulation grid size
+    uint SCREEN_HEIGHT;
+    float sensorOffset;   // How far ahead agents sense, in pixels
+    int sensorLod;        // Trail mip level the sensors read, see sensor_lod() in settings.h
+    float attractorWeight;
+    float attractorLod;   // Attractor mip level that matches a grid pixel
+    int radius;           // Diffusion blur radius
+    float baseSpeed;      // Agent speed in pixels per second
+    float randomTurn;     // Wiggle added to every step's heading
+    float turnSpeed;      // Steering turn, scaled by a random 0.2 to 1.2
+    float sensorAngle;    // Side sensors' angle off the heading
+    float decayRate;      // Trail lost per second
+    float diffuseWeight;  // How far each frame blends towards the blurred neighbourhood
+    float depositAmount;  // Trail added per deposit
+};
@@ -0,0 +1,19 @@
+// Activity flags for the square tiles the trail map is split into, so the
+// sparse diffusion kernel can skip tiles that are empty and stay empty.
+// One uint per tile, row-major.
+const int ACTIVITY_TILE_SIZE = 64;  // Must match diffusion.h
+
+// Bit TILE_TRAIL << (n & 1) is set when frame n of the trail has any trail
+// in the tile. The tile list pass for frame n reads bit n & 1 of the
+// neighbours and clears the other bit, which diffusion then sets for n + 1.
+const uint TILE_TRAIL = 1u;
+const uint TILE_AGENT = 4u;  // Set by the agent pass on tiles it deposits in
+
+layout(std430, binding = 2) buffer TileFlags {
+    uint tileFlags[];
+};
+
+int tile_index(ivec2 pos, int width) {
+    int tilesX = (width + ACTIVITY_TILE_SIZE - 1) / ACTIVITY_TILE_SIZE;
+    return pos.y / ACTIVITY_TILE_SIZE * tilesX + pos.x / ACTIVITY_TILE_SIZE;
+}
@@ -0,0 +1,27 @@
+// Layout of the trail texture arrays, shared by every pass that touches
+// them. The host defines these to match the textures it allocates; the
+// defaults are the original RGBA32F trail with three species.
+#ifndef TRAIL_FORMAT
+#define TRAIL_FORMAT rgba32f  // Image format qualifier
+#endif
+#ifndef TRAIL_CHANNELS
+#define TRAIL_CHANNELS 4      // Species per layer, 3 for formats without alpha
+#endif
+#ifndef SPECIES_COUNT
+#define SPECIES_COUNT 3
+#endif
+
+// Species s is channel s % TRAIL_CHANNELS of layer s / TRAIL_CHANNELS
+const int TRAIL_LAYERS = (SPECIES_COUNT + TRAIL_CHANNELS - 1) / TRAIL_CHANNELS;
+
+// 1.0 for the channels of a layer that hold a species, 0.0 for the rest
+vec4 species_mask(int layer) {
+    ivec4 channel = ivec4(0, 1, 2, 3);
+    return vec4(lessThan(channel, ivec4(TRAIL_CHANNELS))) *
+           vec4(lessThan(channel + layer * TRAIL_CHANNELS, ivec4(SPECIES_COUNT)));
+}
+
+// 1.0 in the channel of a layer that holds species, 0.0 everywhere else
+vec4 species_channel(int species, int layer) {
+    return vec4(equal(ivec4(0, 1, 2, 3) + layer * TRAIL_CHANNELS, ivec4(species))) * species_mask(layer);
+}
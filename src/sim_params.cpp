@@ -0,0 +1,56 @@
+#include "sim_params.h"
+
+#include <cstring>
+
+SimParams sim_params(const Settings& settings) {
+    SimParams params;
+    params.deltaTime = settings.deltaTime;
+    params.seed = settings.seed;
+    params.numAgents = settings.numAgents;
+    params.gridWidth = settings.width;
+    params.gridHeight = settings.height;
+    params.sensorOffset = settings.sensorOffset;
+    params.attractorWeight = settings.attractorWeight;
+    params.diffusionRadius = settings.diffusionRadius;
+    return params;
+}
+
+SimParamsRing::SimParamsRing() {
+    GLint alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    stride = (sizeof(SimParams) + alignment - 1) / alignment * alignment;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferStorage(GL_UNIFORM_BUFFER, stride * COPIES, nullptr, flags);
+    mapped = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, stride * COPIES, flags));
+}
+
+SimParamsRing::~SimParamsRing() {
+    for (GLsync fence : fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    glDeleteBuffers(1, &buffer);
+}
+
+void SimParamsRing::push(const SimParams& params) {
+    // Everything queued since the last push reads the current copy
+    if (current >= 0) {
+        fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    current = (current + 1) % COPIES;
+    if (fences[current]) {
+        while (glClientWaitSync(fences[current], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        glDeleteSync(fences[current]);
+        fences[current] = nullptr;
+    }
+
+    std::memcpy(mapped + current * stride, &params, sizeof(params));
+    glBindBufferRange(GL_UNIFORM_BUFFER, SIM_PARAMS_BINDING, buffer, current * stride, sizeof(params));
+}
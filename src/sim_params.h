@@ -0,0 +1,61 @@
+#pragma once
+#include "config.h"
+#include "settings.h"
+
+#include <cstdint>
+
+// Uniform buffer binding of the SimParams block, see shaders/sim_params.glsl
+const GLuint SIM_PARAMS_BINDING = 1;
+
+// The std140 SimParams block every GL pass reads instead of its own
+// uniforms: per-step values, per-run values and the tunables that used to
+// be constants in the shaders. Only 4-byte scalars, which std140 packs the
+// same as C++. The tunables default to the CPU backend's constants in
+// agent_kernel_impl.h and cpu_simulation.cpp.
+struct SimParams {
+    float deltaTime = 1.0f / 60.0f;
+    uint32_t stepIndex = 0;
+    uint32_t seed = 1;
+    uint32_t numAgents = 0;   // NUM_AGENTS in the shaders
+    uint32_t gridWidth = 0;   // SCREEN_WIDTH
+    uint32_t gridHeight = 0;  // SCREEN_HEIGHT
+    float sensorOffset = BASE_SENSOR_OFFSET;
+    int32_t sensorLod = 0;
+    float attractorWeight = 1.0f;
+    float attractorLod = 0.0f;
+    int32_t diffusionRadius = 1;  // radius
+    float baseSpeed = 100.0f;
+    float randomTurn = 0.2f;
+    float turnSpeed = 0.1f * 3.1415f;
+    float sensorAngle = 3.1415f / 8.0f;
+    float decayRate = 0.4f;
+    float diffuseWeight = 0.1f;
+    float depositAmount = 1.0f;
+    uint32_t padding[2] = {};  // std140 rounds the block up to 16 bytes
+};
+static_assert(sizeof(SimParams) % 16 == 0, "SimParams must match the std140 block size");
+
+// The per-run values from settings; the caller fills in sensorLod and
+// attractorLod, which depend on the textures it made
+SimParams sim_params(const Settings& settings);
+
+// Uploads SimParams through a persistently mapped uniform buffer holding a
+// ring of copies. Each push() writes the next copy and binds it to
+// SIM_PARAMS_BINDING, so passes already queued keep reading theirs and an
+// update never waits for the GPU unless it is a whole ring behind.
+class SimParamsRing {
+public:
+    SimParamsRing();
+    ~SimParamsRing();
+
+    void push(const SimParams& params);
+
+private:
+    // One per step of the frames in flight, plus the tuner's pushes
+    static const int COPIES = 4 * MAX_SUBSTEPS;
+    GLuint buffer;
+    GLintptr stride;        // sizeof(SimParams) rounded up to the offset alignment
+    unsigned char* mapped;  // Coherent, so writes need no flush
+    GLsync fences[COPIES] = {};  // Set once the commands reading a copy are queued
+    int current = -1;
+};
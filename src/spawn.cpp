@@ -0,0 +1,136 @@
+#include "spawn.h"
+#include "philox.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+// Vose's construction of a Walker alias table. Weights are scaled by count
+// so the average is the integer total and the split stays exact; only the
+// thresholds round, once, in double.
+template <typename Weight>
+void build_alias_table(const Weight* weights, uint32_t count, AliasEntry* table) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        total += weights[i];
+    }
+    std::vector<uint64_t> scaled(count);
+    std::vector<uint32_t> small, large;
+    for (uint32_t i = 0; i < count; ++i) {
+        table[i] = {UINT32_MAX, i};  // Kept outright unless paired below
+        scaled[i] = static_cast<uint64_t>(weights[i]) * count;
+        (scaled[i] < total ? small : large).push_back(i);
+    }
+    if (total == 0) {
+        return;  // Never picked, see load_spawn_image
+    }
+
+    // Each small item is topped up to the average by a large one, which
+    // may turn small itself
+    while (!small.empty() && !large.empty()) {
+        uint32_t lower = small.back();
+        small.pop_back();
+        uint32_t upper = large.back();
+        double keep = static_cast<double>(scaled[lower]) / static_cast<double>(total);
+        table[lower] = {static_cast<uint32_t>(std::min(keep * 4294967296.0, 4294967295.0)), upper};
+        scaled[upper] -= total - scaled[lower];
+        if (scaled[upper] < total) {
+            large.pop_back();
+            small.push_back(upper);
+        }
+    }
+}
+
+// Index picked from an alias table, see AliasEntry. The top bits of
+// indexBits scale to [0, count) without modulo bias.
+uint32_t alias_sample(const AliasEntry* table, uint32_t count, uint32_t indexBits, uint32_t thresholdBits) {
+    uint32_t i = static_cast<uint32_t>(static_cast<uint64_t>(indexBits) * count >> 32);
+    return thresholdBits < table[i].threshold ? i : table[i].alias;
+}
+
+}
+
+bool load_spawn_image(const std::string& filename, ThreadPool& pool, SpawnImage& image) {
+    int channels;
+    unsigned char* data = stbi_load(filename.c_str(), &image.width, &image.height, &channels, 1);
+    if (!data) {
+        std::cerr << "Failed to load spawn image " << filename << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+
+    // Rows are independent tables, so they build in parallel. stb_image
+    // starts at the top row.
+    const int width = image.width;
+    const int height = image.height;
+    std::vector<uint64_t> rowWeights(height);
+    image.table.resize(height + static_cast<size_t>(width) * height);
+    pool.parallel_for(0, height, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            const uint8_t* pixels = data + static_cast<size_t>(height - 1 - y) * width;
+            rowWeights[y] = 0;
+            for (int x = 0; x < width; ++x) {
+                rowWeights[y] += pixels[x];
+            }
+            build_alias_table(pixels, width, &image.table[height + static_cast<size_t>(y) * width]);
+        }
+    });
+    stbi_image_free(data);
+
+    if (std::all_of(rowWeights.begin(), rowWeights.end(), [](uint64_t weight) { return weight == 0; })) {
+        std::cerr << "Spawn image " << filename << " is black, nowhere to spawn" << std::endl;
+        return false;
+    }
+    build_alias_table(rowWeights.data(), height, image.table.data());
+    return true;
+}
+
+Agent spawn_agent(SpawnPattern pattern, uint32_t seed, uint32_t id, int width, int height, int speciesCount,
+                  const SpawnImage& image) {
+    Agent agent;
+    agent.species = static_cast<int>(id % speciesCount);  // Species take turns
+
+    philox::Bits bits = philox::random_bits(seed, id, 0, philox::STREAM_SPAWN);
+    float radius = SPAWN_RADIUS * std::min(width, height);
+    switch (pattern) {
+        case SpawnPattern::Uniform:
+            agent.x = philox::random_unit(bits[0]) * width;
+            agent.y = philox::random_unit(bits[1]) * height;
+            agent.angle = philox::random_unit(bits[2]) * 2.0f * 3.14159f;
+            break;
+
+        case SpawnPattern::Disc: {
+            // sqrt keeps the density even, r alone would crowd the centre
+            float r = radius * std::sqrt(philox::random_unit(bits[0]));
+            float theta = philox::random_unit(bits[1]) * 2.0f * 3.14159f;
+            agent.x = width * 0.5f + r * std::cos(theta);
+            agent.y = height * 0.5f + r * std::sin(theta);
+            agent.angle = philox::random_unit(bits[2]) * 2.0f * 3.14159f;
+            break;
+        }
+
+        case SpawnPattern::Ring: {
+            float r = radius * (1.0f - RING_WIDTH * philox::random_unit(bits[0]));
+            float theta = philox::random_unit(bits[1]) * 2.0f * 3.14159f;
+            agent.x = width * 0.5f + r * std::cos(theta);
+            agent.y = height * 0.5f + r * std::sin(theta);
+            agent.angle = theta + 3.14159f;  // Facing the centre
+            break;
+        }
+
+        case SpawnPattern::Image: {
+            // Row, then pixel within the row, then a point within the pixel
+            uint32_t row = alias_sample(image.table.data(), image.height, bits[0], bits[1]);
+            const AliasEntry* rowTable = &image.table[image.height + static_cast<size_t>(row) * image.width];
+            uint32_t column = alias_sample(rowTable, image.width, bits[2], bits[3]);
+            bits = philox::random_bits(seed, id, 1, philox::STREAM_SPAWN);
+            agent.x = (static_cast<float>(column) + philox::random_unit(bits[0])) * (static_cast<float>(width) / image.width);
+            agent.y = (static_cast<float>(row) + philox::random_unit(bits[1])) * (static_cast<float>(height) / image.height);
+            agent.angle = philox::random_unit(bits[2]) * 2.0f * 3.14159f;
+            break;
+        }
+    }
+    return agent;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "agent.h"
+#include "settings.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Must match shaders/agents_init.glsl
+const float SPAWN_RADIUS = 0.45f;     // Disc and ring radius, of the grid's shorter side
+const float RING_WIDTH = 0.05f;       // Of the radius
+
+// One entry of a Walker alias table over count items. A draw picks entry i
+// uniformly, then keeps i if a second 32-bit draw is below threshold and
+// takes alias otherwise, so every item comes up in proportion to its
+// weight in O(1).
+struct AliasEntry {
+    uint32_t threshold;
+    uint32_t alias;
+};
+
+// Spawn density from a greyscale image, stretched over the whole grid. A
+// two-level alias table: the first height entries pick a row by its total
+// brightness, then the row's width entries pick a pixel. Rows are bottom-up
+// like the grid. The layout is the one shaders/agents_init.glsl reads.
+struct SpawnImage {
+    int width = 0;
+    int height = 0;
+    std::vector<AliasEntry> table;
+};
+
+// Reads any format stb_image does, converts it to grey and builds the
+// table, one row per task on pool. Prints a message and returns false if
+// the file can't be read or is all black.
+bool load_spawn_image(const std::string& filename, ThreadPool& pool, SpawnImage& image);
+
+// Starting state of agent id, drawn from philox.h's spawn stream. This is
+// the reference for shaders/agents_init.glsl: uniform and image spawns
+// match it bit for bit, disc and ring ones up to the GPU's sin and cos.
+Agent spawn_agent(SpawnPattern pattern, uint32_t seed, uint32_t id, int width, int height, int speciesCount,
+                  const SpawnImage& image);
@@ -0,0 +1,54 @@
+#include "species.h"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+std::vector<float> default_interactions(int count) {
+    std::vector<float> interactions(static_cast<size_t>(count) * count, -1.0f);
+    for (int i = 0; i < count; ++i) {
+        interactions[i * count + i] = 0.0f;
+    }
+    return interactions;
+}
+
+std::vector<float> own_interactions(int count) {
+    std::vector<float> interactions(static_cast<size_t>(count) * count, 0.0f);
+    for (int i = 0; i < count; ++i) {
+        interactions[i * count + i] = 1.0f;
+    }
+    return interactions;
+}
+
+bool load_interactions(const std::string& filename, int count, std::vector<float>& interactions) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Failed to open " << filename << std::endl;
+        return false;
+    }
+
+    interactions.assign(static_cast<size_t>(count) * count, 0.0f);
+    for (float& value : interactions) {
+        if (!(file >> value)) {
+            std::cerr << filename << ": expected " << count << "x" << count << " interaction weights" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void species_color(int species, int count, float rgb[3]) {
+    if (count <= 3) {
+        for (int c = 0; c < 3; ++c) {
+            rgb[c] = c == species ? 1.0f : 0.0f;
+        }
+        return;
+    }
+
+    // Fully saturated hue wheel, starting at red
+    float hue = 6.0f * species / count;
+    for (int c = 0; c < 3; ++c) {
+        float distance = std::fabs(std::fmod(hue - 2.0f * c + 6.0f, 6.0f) - 3.0f);
+        rgb[c] = std::fmin(std::fmax(distance - 1.0f, 0.0f), 1.0f);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Species are indexed 0..count-1 and each one deposits into its own trail
+// channel. How strongly species a is drawn to species b's trail is
+// interactions[a * count + b]: positive attracts, negative repels.
+const int MAX_SPECIES = 16;
+
+// Every species ignores its own trail and is repelled by all the others.
+// With three species that is the original red/green/blue behaviour.
+std::vector<float> default_interactions(int count);
+
+// Every species follows its own trail and ignores the others
+std::vector<float> own_interactions(int count);
+
+// Reads count * count whitespace-separated numbers, one row per sensing
+// species. Prints a message and returns false if the file is missing or
+// malformed.
+bool load_interactions(const std::string& filename, int count, std::vector<float>& interactions);
+
+// Display colour of a species: red, green and blue for the first three
+// when there are at most three, otherwise evenly spaced hues
+void species_color(int species, int count, float rgb[3]);
@@ -0,0 +1,82 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0) {
+            threadCount = 1;
+        }
+    }
+    for (unsigned i = 1; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallel_for(int begin, int end, const std::function<void(int, int)>& body) {
+    if (end <= begin) {
+        return;
+    }
+    if (workers.empty() || end - begin == 1) {
+        body(begin, end);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &body;
+        jobBegin = begin;
+        jobEnd = end;
+        pending = static_cast<unsigned>(workers.size());
+        ++generation;
+    }
+    wake.notify_all();
+
+    // The calling thread always takes the first chunk
+    run_chunk(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return pending == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::run_chunk(unsigned index) {
+    long long count = jobEnd - jobBegin;
+    int chunkBegin = jobBegin + static_cast<int>(count * index / size());
+    int chunkEnd = jobBegin + static_cast<int>(count * (index + 1) / size());
+    if (chunkBegin < chunkEnd) {
+        (*job)(chunkBegin, chunkEnd);
+    }
+}
+
+void ThreadPool::worker_loop(unsigned index) {
+    unsigned long long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+
+        run_chunk(index);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --pending;
+        }
+        finished.notify_one();
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads used by the CPU backend. The calling thread
+// takes part in every job, so a pool of size 1 runs everything inline.
+class ThreadPool {
+public:
+    // threadCount == 0 picks std::thread::hardware_concurrency()
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    // Splits [begin, end) into one contiguous chunk per thread and calls
+    // body(chunkBegin, chunkEnd) for each. Blocks until every chunk is done.
+    void parallel_for(int begin, int end, const std::function<void(int, int)>& body);
+
+private:
+    void worker_loop(unsigned index);
+    void run_chunk(unsigned index);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    const std::function<void(int, int)>* job = nullptr;
+    int jobBegin = 0;
+    int jobEnd = 0;
+    unsigned long long generation = 0;
+    unsigned pending = 0;
+    bool stopping = false;
+};
@@ -0,0 +1,48 @@
+#include "trail_format.h"
+
+GLenum trail_internal_format(TrailFormat format) {
+    switch (format) {
+        case TrailFormat::Rgba32f: return GL_RGBA32F;
+        case TrailFormat::Rgba16f: return GL_RGBA16F;
+        case TrailFormat::R11g11b10f: return GL_R11F_G11F_B10F;
+        case TrailFormat::Rgb10a2: return GL_RGB10_A2;
+    }
+    return GL_RGBA32F;
+}
+
+int trail_channels(TrailFormat format) {
+    // R11G11B10F has no alpha and RGB10_A2's two bits can't hold a trail
+    return format == TrailFormat::R11g11b10f || format == TrailFormat::Rgb10a2 ? 3 : 4;
+}
+
+int trail_layers(TrailFormat format, int speciesCount) {
+    int channels = trail_channels(format);
+    return (speciesCount + channels - 1) / channels;
+}
+
+ShaderPermutation trail_permutation(TrailFormat format, int speciesCount) {
+    const char* qualifier = "rgba32f";
+    switch (format) {
+        case TrailFormat::Rgba32f: qualifier = "rgba32f"; break;
+        case TrailFormat::Rgba16f: qualifier = "rgba16f"; break;
+        case TrailFormat::R11g11b10f: qualifier = "r11f_g11f_b10f"; break;
+        case TrailFormat::Rgb10a2: qualifier = "rgb10_a2"; break;
+    }
+    return ShaderPermutation()
+        .define("TRAIL_FORMAT", qualifier)
+        .define("TRAIL_CHANNELS", trail_channels(format))
+        .define("SPECIES_COUNT", speciesCount);
+}
+
+std::vector<float> pack_interactions(TrailFormat format, int speciesCount, const std::vector<float>& interactions) {
+    int channels = trail_channels(format);
+    int layers = trail_layers(format, speciesCount);
+    std::vector<float> packed(speciesCount * layers * 4, 0.0f);
+    for (int sensing = 0; sensing < speciesCount; ++sensing) {
+        for (int trail = 0; trail < speciesCount; ++trail) {
+            int index = (sensing * layers + trail / channels) * 4 + trail % channels;
+            packed[index] = interactions[sensing * speciesCount + trail];
+        }
+    }
+    return packed;
+}
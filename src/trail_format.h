@@ -0,0 +1,27 @@
+#pragma once
+#include "config.h"
+#include "settings.h"
+#include "shader.h"
+
+#include <vector>
+
+// GL internal format of trail textures in this format, for glTexStorage2D
+// and glBindImageTexture
+GLenum trail_internal_format(TrailFormat format);
+
+// Species stored per texture layer: 4, or 3 for formats whose alpha is too
+// narrow to hold a trail
+int trail_channels(TrailFormat format);
+
+// Layers of the trail texture array for speciesCount species
+int trail_layers(TrailFormat format, int speciesCount);
+
+// Permutation of shaders that access trail images, see shaders/trail.glsl:
+// TRAIL_FORMAT is the matching image format qualifier, TRAIL_CHANNELS and
+// SPECIES_COUNT the layout of the texture array
+ShaderPermutation trail_permutation(TrailFormat format, int speciesCount);
+
+// The interaction matrix (species.h) as the std140 Interactions block of
+// agents.glsl: per sensing species one vec4 per trail layer, holding the
+// weights of the species in that layer's channels and zero elsewhere
+std::vector<float> pack_interactions(TrailFormat format, int speciesCount, const std::vector<float>& interactions);
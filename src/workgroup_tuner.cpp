@@ -0,0 +1,100 @@
+#include "workgroup_tuner.h"
+#include "gpu_timer.h"
+
+namespace {
+
+const int WARMUP_RUNS = 2;  // Untimed, lets clocks and caches settle
+const int TIMED_RUNS = 8;
+
+std::string gl_string(GLenum name) {
+    const GLubyte* value = glGetString(name);
+    return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+}
+
+std::string workgroup_defines(WorkgroupSize size) {
+    return "#define LOCAL_SIZE_X " + std::to_string(size.x) + "\n" +
+           "#define LOCAL_SIZE_Y " + std::to_string(size.y) + "\n";
+}
+
+WorkgroupTuner::WorkgroupTuner(const std::string& cacheFile) : cacheFile(cacheFile) {
+    driver = gl_string(GL_VENDOR) + " / " + gl_string(GL_RENDERER) + " / " + gl_string(GL_VERSION);
+
+    // One tab-separated line per entry: driver, key, x, y
+    std::ifstream file(cacheFile);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string entryDriver, key, x, y;
+        if (std::getline(fields, entryDriver, '\t') && std::getline(fields, key, '\t') &&
+            std::getline(fields, x, '\t') && std::getline(fields, y)) {
+            try {
+                cache[entryDriver][key] = {std::stoi(x), std::stoi(y)};
+            } catch (...) {
+                // Skip malformed lines, the kernel is tuned again
+            }
+        }
+    }
+}
+
+WorkgroupSize WorkgroupTuner::tune(const std::string& key, const std::vector<WorkgroupSize>& candidates,
+                                   const std::function<unsigned int(WorkgroupSize)>& build,
+                                   const std::function<void(unsigned int, WorkgroupSize)>& dispatch) {
+    auto cached = cache[driver].find(key);
+    if (cached != cache[driver].end()) {
+        return cached->second;
+    }
+
+    GLint maxInvocations = 0;
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+
+    WorkgroupSize best = candidates.front();
+    double bestMs = -1.0;
+    GpuTimer timer;
+    for (WorkgroupSize size : candidates) {
+        if (size.x * size.y > maxInvocations) {
+            continue;
+        }
+        unsigned int program = build(size);
+        for (int run = 0; run < WARMUP_RUNS; ++run) {
+            dispatch(program, size);
+            glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        }
+
+        // One query around all the timed runs, with the barriers between
+        // them: some drivers defer a lone dispatch past the query's end
+        timer.begin();
+        for (int run = 0; run < TIMED_RUNS; ++run) {
+            dispatch(program, size);
+            glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        }
+        timer.end();
+        glFinish();
+        double ms = timer.take_average_ms() / TIMED_RUNS;
+        glDeleteProgram(program);
+
+        if (ms >= 0.0 && (bestMs < 0.0 || ms < bestMs)) {
+            best = size;
+            bestMs = ms;
+        }
+    }
+
+    std::cout << "Tuned " << key << ": " << best.x << "x" << best.y << " (" << bestMs << " ms)" << std::endl;
+    cache[driver][key] = best;
+    save();
+    return best;
+}
+
+void WorkgroupTuner::save() {
+    std::ofstream file(cacheFile);
+    if (!file) {
+        std::cerr << "Failed to write workgroup cache " << cacheFile << std::endl;
+        return;
+    }
+    for (const auto& entries : cache) {
+        for (const auto& entry : entries.second) {
+            file << entries.first << '\t' << entry.first << '\t' << entry.second.x << '\t' << entry.second.y << '\n';
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "config.h"
+
+#include <functional>
+#include <map>
+
+// Compute workgroup dimensions, z is always 1
+struct WorkgroupSize {
+    int x, y;
+};
+
+// Defines LOCAL_SIZE_X and LOCAL_SIZE_Y for a shader's layout qualifier
+std::string workgroup_defines(WorkgroupSize size);
+
+// Picks compute workgroup sizes by timing candidates on the current device.
+// Winners are cached in a file per driver (GL vendor, renderer and version),
+// so only the first run on a driver pays for tuning.
+class WorkgroupTuner {
+public:
+    explicit WorkgroupTuner(const std::string& cacheFile);
+
+    // Cached size for key, or else the candidate whose program runs fastest.
+    // build compiles the kernel for a size and dispatch runs that program
+    // once, on resources the caller doesn't mind being overwritten.
+    // Candidates over the device's invocation limit are skipped.
+    WorkgroupSize tune(const std::string& key, const std::vector<WorkgroupSize>& candidates,
+                       const std::function<unsigned int(WorkgroupSize)>& build,
+                       const std::function<void(unsigned int, WorkgroupSize)>& dispatch);
+
+private:
+    void save();
+
+    std::string cacheFile;
+    std::string driver;
+
+    // Entries for every driver in the file, so tuning on one driver keeps
+    // the others' results
+    std::map<std::string, std::map<std::string, WorkgroupSize>> cache;
+};